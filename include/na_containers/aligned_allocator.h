@@ -0,0 +1,135 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <limits>
+#ifdef _MSC_VER
+#include <malloc.h>
+#else
+#include <stdlib.h>
+#endif
+
+namespace na {
+
+	// Allocator returning memory aligned to Alignment bytes (a power of two,
+	// at least sizeof(void*)).
+	//
+	// Besides aligning the buffer, it is the layout policy for array2d: an
+	// array2d whose container uses aligned_allocator pads its major stride so
+	// that every major slice starts on an Alignment boundary, e.g.
+	//
+	//   array2d< na_vector< float, policies::NaPolicySV<float>, aligned_allocator<float,64> > >
+	template< typename T, std::size_t Alignment = 64 >
+	class aligned_allocator {
+		static_assert( Alignment >= sizeof(void*) && (Alignment & (Alignment - 1)) == 0, "Alignment must be a power of two" );
+
+	public:
+		typedef T value_type;
+		typedef T* pointer;
+		typedef const T* const_pointer;
+		typedef T& reference;
+		typedef const T& const_reference;
+		typedef std::size_t size_type;
+		typedef std::ptrdiff_t difference_type;
+
+		static const std::size_t alignment = Alignment;
+
+		template< typename U >
+		struct rebind {
+			typedef aligned_allocator< U, Alignment > other;
+		};
+
+	public:
+		aligned_allocator()
+		{
+		}
+
+		template< typename U >
+		aligned_allocator( const aligned_allocator< U, Alignment >& )
+		{
+		}
+
+		pointer address( reference x ) const
+		{
+			return &x;
+		}
+
+		const_pointer address( const_reference x ) const
+		{
+			return &x;
+		}
+
+		pointer allocate( size_type n, const void* = 0 )
+		{
+			if( n > max_size() ) {
+				throw std::bad_alloc();
+			}
+			if( n == 0 ) {
+				n = 1;
+			}
+#ifdef _MSC_VER
+			void* result = _aligned_malloc( n * sizeof(T), Alignment );
+#else
+			void* result = 0;
+			if( posix_memalign( &result, Alignment, n * sizeof(T) ) != 0 ) {
+				result = 0;
+			}
+#endif
+			if( !result ) {
+				throw std::bad_alloc();
+			}
+			return static_cast< pointer >( result );
+		}
+
+		void deallocate( pointer p, size_type )
+		{
+#ifdef _MSC_VER
+			_aligned_free( p );
+#else
+			free( p );
+#endif
+		}
+
+		size_type max_size() const
+		{
+			return (std::numeric_limits< size_type >::max)() / sizeof(T);
+		}
+
+		void construct( pointer p, const T& val )
+		{
+			::new( static_cast< void* >( p ) ) T( val );
+		}
+
+		void destroy( pointer p )
+		{
+			p->~T();
+		}
+	};
+
+	template< typename T, std::size_t Alignment >
+	const std::size_t aligned_allocator< T, Alignment >::alignment;
+
+	template< typename T, typename U, std::size_t Alignment >
+	bool operator==( const aligned_allocator< T, Alignment >&, const aligned_allocator< U, Alignment >& )
+	{
+		return true;
+	}
+
+	template< typename T, typename U, std::size_t Alignment >
+	bool operator!=( const aligned_allocator< T, Alignment >&, const aligned_allocator< U, Alignment >& )
+	{
+		return false;
+	}
+
+	// Alignment in bytes an allocator guarantees beyond the default one,
+	// 0 if none.
+	template< typename Allocator >
+	struct allocator_alignment {
+		static const std::size_t value = 0;
+	};
+
+	template< typename T, std::size_t Alignment >
+	struct allocator_alignment< aligned_allocator< T, Alignment > > {
+		static const std::size_t value = Alignment;
+	};
+
+}
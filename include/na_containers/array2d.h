@@ -3,6 +3,11 @@
 #include <utility>
 #include <type_traits>
 #include <boost/iterator/iterator_facade.hpp>
+#include <na_containers/na_vector.h>
+#include <na_containers/aligned_allocator.h>
+#include <na_containers/gather.h>
+#include <na_containers/parallel.h>
+#include <na_containers/array2d_profile.h>
 
 namespace order {
 	struct row_major {};
@@ -33,31 +38,53 @@ namespace detail {
 	public:
 		element_iterator()
 			: ptr_(nullptr), stride_(1)
+#ifdef NA_ARRAY2D_PROFILE
+			, counters_(nullptr)
+#endif
 		{
 		}
 
 		element_iterator( ValueType* ptr, difference_type stride )
 			: ptr_( ptr ), stride_( stride )
+#ifdef NA_ARRAY2D_PROFILE
+			, counters_(nullptr)
+#endif
 		{
 		}
 
+#ifdef NA_ARRAY2D_PROFILE
+		element_iterator( ValueType* ptr, difference_type stride, na::detail::access_counters* counters )
+			: ptr_( ptr ), stride_( stride ), counters_( counters )
+		{
+		}
+#endif
+
 		element_iterator( const element_iterator& other )
 			: ptr_( other.ptr_ ), stride_( other.stride_ )
+#ifdef NA_ARRAY2D_PROFILE
+			, counters_( other.counters_ )
+#endif
 		{
 		}
 
 		operator element_iterator< const ValueType, tags::minor_tag >() const
 		{
-			return element_iterator< const ValueType, tags::minor_tag >(ptr_);
+#ifdef NA_ARRAY2D_PROFILE
+			return element_iterator< const ValueType, tags::minor_tag >( ptr_, stride_, counters_ );
+#else
+			return element_iterator< const ValueType, tags::minor_tag >( ptr_, stride_ );
+#endif
 		}
 
 		reference dereference()
 		{
+			NA_PROFILE_COUNT( counters_, minor_elements );
 			return *ptr_;
 		}
 
 		reference dereference() const
 		{
+			NA_PROFILE_COUNT( counters_, minor_elements );
 			return *ptr_;
 		}
 
@@ -89,6 +116,9 @@ namespace detail {
 	private:
 		ValueType* ptr_;
 		difference_type stride_;
+#ifdef NA_ARRAY2D_PROFILE
+		na::detail::access_counters* counters_;
+#endif
 	};
 
 	template< typename ValueType >
@@ -96,31 +126,53 @@ namespace detail {
 	public:
 		element_iterator()
 			: ptr_(nullptr)
+#ifdef NA_ARRAY2D_PROFILE
+			, counters_(nullptr)
+#endif
 		{
 		}
 
 		element_iterator( ValueType* ptr )
 			: ptr_( ptr )
+#ifdef NA_ARRAY2D_PROFILE
+			, counters_(nullptr)
+#endif
 		{
 		}
 
+#ifdef NA_ARRAY2D_PROFILE
+		element_iterator( ValueType* ptr, na::detail::access_counters* counters )
+			: ptr_( ptr ), counters_( counters )
+		{
+		}
+#endif
+
 		element_iterator( const element_iterator& other )
 			: ptr_( other.ptr_ )
+#ifdef NA_ARRAY2D_PROFILE
+			, counters_( other.counters_ )
+#endif
 		{
 		}
 
 		operator element_iterator< const ValueType, tags::major_tag >() const
 		{
+#ifdef NA_ARRAY2D_PROFILE
+			return element_iterator< const ValueType, tags::major_tag >( ptr_, counters_ );
+#else
 			return element_iterator< const ValueType, tags::major_tag >( ptr_ );
+#endif
 		}
 
 		reference dereference()
 		{
+			NA_PROFILE_COUNT( counters_, major_elements );
 			return *ptr_;
 		}
 
 		const reference dereference() const
 		{
+			NA_PROFILE_COUNT( counters_, major_elements );
 			return *ptr_;
 		}
 
@@ -151,6 +203,9 @@ namespace detail {
 
 	private:
 		ValueType* ptr_;
+#ifdef NA_ARRAY2D_PROFILE
+		na::detail::access_counters* counters_;
+#endif
 	};
 
 	template< typename ContainerType, typename OrderType, bool IsConst, typename Tag >
@@ -257,11 +312,13 @@ namespace detail {
 
 		reference dereference()
 		{
+			NA_PROFILE_SLICE( table_->profile_, Tag() );
 			return value_type( table_, index_ );
 		}
 
 		const reference dereference() const
 		{
+			NA_PROFILE_SLICE( table_->profile_, Tag() );
 			return value_type( table_, index_ );
 		}
 
@@ -374,7 +431,7 @@ namespace detail {
 		typedef typename ContainerType::value_type value_type;
 		typedef typename ContainerType::reference reference;
 		typedef typename ContainerType::difference_type difference_type;
-		typedef const reference const_reference;
+		typedef typename ContainerType::const_reference const_reference;
 		typedef std::size_t size_type;
 		typedef ContainerType container_type;
 
@@ -424,6 +481,18 @@ namespace detail {
 
 }
 
+namespace na {
+	namespace detail {
+
+		// NA policy of the elements of an array2d-like type.
+		template< typename Array >
+		struct array_policy {
+			typedef typename Array::container_type::policy_type type;
+		};
+
+	}
+}
+
 template< typename ContainerType, typename OrderType = order::column_major >
 class array2d : public detail::array2d_types< ContainerType, OrderType > {
 public:
@@ -433,8 +502,36 @@ public:
 		_max_size( row_tag() ) = rows;
 		_size( column_tag() )  = cols;
 		_max_size( column_tag() ) = cols;
+		major_max_ = _pad_stride( major_max_ );
+
+		data_.resize( minor_max_ * major_max_ );
+	}
+
+	// Allocates without the serial fill and fills the major slices from
+	// several threads, so with default_init_allocator each thread first-touches
+	// the slices that a later parallel_for over the major slices gives it.
+	array2d( size_type rows, size_type cols, const value_type& val, const na::parallel_t& par )
+	{
+		_size( row_tag() )     = rows;
+		_max_size( row_tag() ) = rows;
+		_size( column_tag() )  = cols;
+		_max_size( column_tag() ) = cols;
+		major_max_ = _pad_stride( major_max_ );
+
+		data_.resize_default_init( minor_max_ * major_max_ );
+		_fill_slices( val, par );
+	}
+
+	array2d( size_type rows, size_type cols, const na::detail::_na_type&, const na::parallel_t& par )
+	{
+		_size( row_tag() )     = rows;
+		_max_size( row_tag() ) = rows;
+		_size( column_tag() )  = cols;
+		_max_size( column_tag() ) = cols;
+		major_max_ = _pad_stride( major_max_ );
 
-		data_.resize( minor_size_ * major_size_ );
+		data_.resize_default_init( minor_max_ * major_max_ );
+		_fill_slices( ContainerType::get_na(), par );
 	}
 
 	array2d()
@@ -470,10 +567,12 @@ public:
 	}
 
 	reference dereference( size_type row, size_type col ) {
+		NA_PROFILE_DEREFERENCE( profile_, to_index( row, col ), major_max_ );
 		return data_[to_index( row, col )];
 	}
 
 	const_reference dereference( size_type row, size_type col ) const {
+		NA_PROFILE_DEREFERENCE( profile_, to_index( row, col ), major_max_ );
 		return data_[to_index( row, col )];
 	}
 
@@ -489,73 +588,65 @@ public:
 	
 	void resize( size_type rows, size_type cols )
 	{
-		if( rows * cols < data_.capacity() ) {
+		if( _fits( rows, cols ) ) {
 			reshape( rows, cols );
 		} else {
-			array2d other( rows, cols );
-
-			auto major1_end = major_slice_end();
-			auto major2_end = other.major_slice_end();
-
-			for( auto major1 = major_slice_begin(), major2 = other.major_slice_begin();
-				 major1 != major1_end && major2 != major2_end;
-				 ++major1,++major2 )
-			{
-				for( auto minor1 = major1->begin(), minor2 = major2->begin();
-					 minor1 != major1->end() && minor2 != major2->end();
-					 ++minor1,++minor2 ) {
-					*minor2 = *minor1;
-				}
-			}
+			_grow( array2d( rows, cols ) );
+		}
+	}
 
-			swap( other );
+	// Like resize(), but a new allocation is NA-filled in parallel.
+	void resize( size_type rows, size_type cols, const na::parallel_t& par )
+	{
+		if( _fits( rows, cols ) ) {
+			reshape( rows, cols );
+		} else {
+			_grow( array2d( rows, cols, ContainerType::get_na(), par ) );
 		}
 	}
 
 	void reserve( size_type rows, size_type cols )
 	{
 		auto sizepair = _to_major_minor( rows, cols, OrderType() );
-		sizepair.first  = std::max( major_max_, sizepair.first );
+		sizepair.first  = std::max( major_max_, _pad_stride( sizepair.first ) );
 		sizepair.second = std::max( minor_max_, sizepair.second );
 
-		if( sizepair.first * sizepair.second > data_.capacity() ) {
+		if( sizepair.first * sizepair.second > data_.size() ) {
 			data_.resize( sizepair.first * sizepair.second );
-			for( size_type i = minor_size_-1; i >= 1; --i ) {
-				std::move_backward( data()+i*major_max_, data()+i*major_max_+sizepair.first, data()+i*sizepair.first+sizepair.first );
-			}
-			major_max_ = sizepair.first;
-			minor_max_ = sizepair.second;
-		} else {
-			reshape( rows, cols );
 		}
+
+		_restride( sizepair.first );
+		minor_max_ = sizepair.second;
 	}
 
 	void reshape( size_type rows, size_type cols )
 	{
-		if( rows * cols > data_.capacity() ) {
+		if( !_fits( rows, cols ) ) {
 			// need more space
 			resize( rows, cols );
 		} else {
-			// Need to align majors with new pattern
 			auto sizepair = _to_major_minor( rows, cols, OrderType() );
-
-			size_type new_major_max_ = data_.capacity()/sizepair.second;
-			size_type new_minor_max_ = sizepair.second;
-
-			if( sizepair.first < major_size_ ) {
-				for( size_type i = 1; i < minor_size_; ++i ) {
-					std::move( data()+i*major_max_, data()+i*major_max_+sizepair.first, data()+i*new_major_max_ );
-				}
-			} else {
-				for( size_type i = minor_size_-1; i >= 1; --i ) {
-					std::move_backward( data()+i*major_max_, data()+i*major_max_+major_max_, data()+i*new_major_max_+major_max_ );
+			const size_type kept_major = std::min( major_size_, sizepair.first );
+			const size_type kept_minor = std::min( minor_size_, sizepair.second );
+
+			if( sizepair.first > major_max_ || sizepair.second > minor_max_ ) {
+				// Need to align majors with new pattern: take the widest stride
+				// the allocation allows, which leaves the most room to grow.
+				const size_type padded = _pad_stride( sizepair.first );
+				size_type widest = data_.size()/std::max( sizepair.second, size_type(1) );
+				widest -= widest % major_alignment();
+				if( major_alignment() > 1 && (widest * sizeof(value_type)) % 4096 == 0 && widest >= padded + major_alignment() ) {
+					widest -= major_alignment();
 				}
+				// slices beyond the new minor size are dropped, not moved
+				minor_size_ = std::min( minor_size_, sizepair.second );
+				_restride( std::max( padded, widest ) );
+				minor_max_ = data_.size()/std::max( major_max_, size_type(1) );
 			}
 
-			major_max_ = new_major_max_;
-			minor_max_ = new_minor_max_;
 			major_size_ = sizepair.first;
 			minor_size_ = sizepair.second;
+			_fill_exposed( kept_major, kept_minor );
 		}
 	}
 	
@@ -567,51 +658,98 @@ public:
 		return data_.data();
 	}
 
-	size_type to_index( size_type row, size_type col )
+	size_type to_index( size_type row, size_type col ) const
 	{
 		return _to_index( row, col, order_type() );
 	}
 
+	// Storage layout: there are minor_size() major slices, each holding
+	// major_size() contiguous elements, starting stride() elements apart.
+	size_type major_size() const
+	{
+		return major_size_;
+	}
+
+	size_type minor_size() const
+	{
+		return minor_size_;
+	}
+
+	size_type stride() const
+	{
+		return _stride();
+	}
+
+	// Number of elements every stride() is a multiple of. Greater than one
+	// when the container's allocator is an na::aligned_allocator: then
+	// data() is aligned and so is the start of every major slice. That is
+	// lcm( alignment, sizeof(value_type) ) / sizeof(value_type) elements, which
+	// also holds when the element size does not divide the alignment.
+	static size_type major_alignment()
+	{
+		const size_type alignment = na::allocator_alignment< typename ContainerType::allocator_type >::value;
+		size_type a = alignment, b = sizeof(value_type);
+		while( b ) {
+			const size_type r = a % b;
+			a = b;
+			b = r;
+		}
+		return alignment ? alignment / a : 1;
+	}
+
 
 private:
+	// _size( tag ) is the number of slices of that kind. A major slice spans
+	// major_size_ elements, so there are minor_size_ of them and vice versa.
 	size_type& _size( tags::major_tag )
 	{
-		return major_size_;
+		return minor_size_;
 	}
 
 	size_type& _size( tags::minor_tag )
+	{
+		return major_size_;
+	}
+
+	size_type _size( tags::major_tag ) const
 	{
 		return minor_size_;
 	}
 
+	size_type _size( tags::minor_tag ) const
+	{
+		return major_size_;
+	}
+
 	size_type& _max_size( tags::major_tag )
 	{
-		return major_max_;
+		return minor_max_;
 	}
 
 	size_type& _max_size( tags::minor_tag )
 	{
-		return minor_max_;
+		return major_max_;
 	}
 	
-	size_type _to_index( size_type row, size_type col, order::column_major )
+	size_type _to_index( size_type row, size_type col, order::column_major ) const
 	{
 		return col * major_max_ + row;
 	}
 
-	size_type _to_index( size_type row, size_type col, order::row_major )
+	size_type _to_index( size_type row, size_type col, order::row_major ) const
 	{
 		return col + row * major_max_;
 	}
 
-	std::pair< size_type, size_type > _to_major_minor( size_type row, size_type col, order::column_major )
+	// (elements per major slice, number of major slices)
+	std::pair< size_type, size_type > _to_major_minor( size_type row, size_type col, order::column_major ) const
 	{
-		return std::make_pair( col, row );
+		return std::make_pair( row, col );
 	}
 
-	std::pair< size_type, size_type > _to_major_minor( size_type row, size_type col, order::row_major )
+	std::pair< size_type, size_type > _to_major_minor( size_type row, size_type col, order::row_major ) const
 	{
-		return std::make_pair( row, col );
+		return std::make_pair( col, row );
 	}
 
 	size_type _stride() const
@@ -619,6 +757,130 @@ private:
 		return major_max_;
 	}
 
+	// Element `major` of major slice `minor` is ( row, col ) = ( major, minor )
+	// column-major and ( minor, major ) row-major.
+	template< typename Function, typename Value >
+	static void _visit( Function& f, size_type major, size_type minor, Value& val, order::column_major )
+	{
+		f( major, minor, val );
+	}
+
+	template< typename Function, typename Value >
+	static void _visit( Function& f, size_type major, size_type minor, Value& val, order::row_major )
+	{
+		f( minor, major, val );
+	}
+
+	template< typename Value, typename Function >
+	void _visit_elements( Value* base, Function& f ) const
+	{
+		const size_type major = major_size_, minor = minor_size_, stride = _stride();
+
+		if( stride == major ) {
+			const size_type count = major * minor;
+			size_type j = 0, i = 0;
+			for( size_type k = 0; k < count; ++k ) {
+				_visit( f, j, i, base[k], order_type() );
+				if( ++j == major ) {
+					j = 0;
+					++i;
+				}
+			}
+			return;
+		}
+
+		for( size_type i = 0; i < minor; ++i ) {
+			Value* slice = base + i * stride;
+			for( size_type j = 0; j < major; ++j ) {
+				_visit( f, j, i, slice[j], order_type() );
+			}
+		}
+	}
+
+	// Rounds a major extent up to the stride used for it. With an aligned
+	// allocator the stride becomes a multiple of the alignment, and a stride
+	// that is a multiple of 4K bytes gets one more alignment unit so that
+	// neighbouring slices do not alias in the cache.
+	static size_type _pad_stride( size_type extent )
+	{
+		const size_type align = major_alignment();
+		if( align == 1 ) {
+			return extent;
+		}
+
+		size_type result = (extent + align - 1) / align * align;
+		if( result && (result * sizeof(value_type)) % 4096 == 0 ) {
+			result += align;
+		}
+		return result;
+	}
+
+	bool _fits( size_type rows, size_type cols ) const
+	{
+		auto sizepair = _to_major_minor( rows, cols, OrderType() );
+		return _pad_stride( sizepair.first ) * sizepair.second <= data_.size();
+	}
+
+	// Copies the overlapping part into a freshly allocated array and takes it over.
+	void _grow( array2d&& other )
+	{
+		auto major1_end = major_slice_end();
+		auto major2_end = other.major_slice_end();
+
+		for( auto major1 = major_slice_begin(), major2 = other.major_slice_begin();
+			 major1 != major1_end && major2 != major2_end;
+			 ++major1,++major2 )
+		{
+			auto slice1 = *major1;
+			auto slice2 = *major2;
+			for( auto minor1 = slice1.begin(), minor2 = slice2.begin();
+				 minor1 != slice1.end() && minor2 != slice2.end();
+				 ++minor1,++minor2 ) {
+				*minor2 = *minor1;
+			}
+		}
+
+		swap( other );
+	}
+
+	void _fill_slices( const value_type& val, const na::parallel_t& par )
+	{
+		value_type* base = data();
+		const size_type stride = major_max_;
+		na::detail::parallel_for( minor_max_, std::max( na::detail::parallel_fill_grain / std::max( stride, size_type(1) ), size_type(1) ), par,
+			[=]( size_type first, size_type last ) {
+				std::fill( base + first * stride, base + last * stride, val );
+			} );
+	}
+
+	// Sets to NA what a reshape brought into view: the tail past kept_major
+	// of the first kept_minor slices and all of the slices after them. Those
+	// cells hold moved-from or previously cut off values.
+	void _fill_exposed( size_type kept_major, size_type kept_minor )
+	{
+		const value_type na = ContainerType::get_na();
+		for( size_type i = 0; i < minor_size_; ++i ) {
+			value_type* slice = data() + i * major_max_;
+			std::fill( slice + (i < kept_minor ? kept_major : 0), slice + major_size_, na );
+		}
+	}
+
+	// Moves the major slices to a new stride inside data_, which must already be large enough.
+	void _restride( size_type new_stride )
+	{
+		if( new_stride > major_max_ ) {
+			for( size_type i = minor_size_; i-- > 1; ) {
+				std::move_backward( data()+i*major_max_, data()+i*major_max_+major_size_, data()+i*new_stride+major_size_ );
+			}
+		} else if( new_stride < major_max_ ) {
+			const size_type count = std::min( major_size_, new_stride );
+			for( size_type i = 1; i < minor_size_; ++i ) {
+				std::move( data()+i*major_max_, data()+i*major_max_+count, data()+i*new_stride );
+			}
+		}
+		major_max_ = new_stride;
+	}
+
 	container_type data_;
 
 	size_type minor_max_;
@@ -627,6 +889,19 @@ private:
 	size_type minor_size_;
 	size_type major_size_;
 
+#ifdef NA_ARRAY2D_PROFILE
+	mutable na::detail::access_profile< OrderType > profile_;
+
+public:
+	// Traversal counters of this array so far.
+	const na::detail::access_counters& access_profile() const
+	{
+		return profile_;
+	}
+
+private:
+#endif
+
 #pragma region Sequences
 // sequences
 public:
@@ -661,7 +936,7 @@ public:
 
 	row_slice_iterator row_end()
 	{
-		return row_slice_iterator( this, rows_ );
+		return row_slice_iterator( this, rows() );
 	}
 
 	const_row_slice_iterator row_begin() const
@@ -671,7 +946,7 @@ public:
 
 	const_row_slice_iterator row_end() const
 	{
-		return const_row_slice_iterator( this, rows_ );
+		return const_row_slice_iterator( this, rows() );
 	}
 
 	const_row_slice_iterator row_cbegin() const
@@ -681,7 +956,7 @@ public:
 
 	const_row_slice_iterator row_cend() const
 	{
-		return const_row_slice_iterator( this, rows_ );
+		return const_row_slice_iterator( this, rows() );
 	}
 
 	col_slice_iterator col_begin()
@@ -691,7 +966,7 @@ public:
 
 	col_slice_iterator col_end()
 	{
-		return col_slice_iterator( this, cols_ );
+		return col_slice_iterator( this, cols() );
 	}
 
 	const_col_slice_iterator col_begin() const
@@ -701,7 +976,7 @@ public:
 
 	const_col_slice_iterator col_end() const
 	{
-		return const_col_slice_iterator( this, cols_ );
+		return const_col_slice_iterator( this, cols() );
 	}
 
 	const_col_slice_iterator col_cbegin() const
@@ -711,7 +986,7 @@ public:
 
 	const_col_slice_iterator col_cend() const
 	{
-		return const_col_slice_iterator( this, cols_ );
+		return const_col_slice_iterator( this, cols() );
 	}
 
 		major_slice_iterator major_slice_begin()
@@ -746,37 +1021,133 @@ public:
 	
 	major_slice_iterator major_slice_end()
 	{
-		return major_slice_iterator( this, major_size_ );
+		return major_slice_iterator( this, minor_size_ );
 	}
 
 	const_major_slice_iterator major_slice_end() const
 	{
-		return const_major_slice_iterator( this, major_size_ );
+		return const_major_slice_iterator( this, minor_size_ );
 	}
 
 	const_major_slice_iterator major_slice_cend() const
 	{
-		return const_major_slice_iterator( this, major_size_ );
+		return const_major_slice_iterator( this, minor_size_ );
 	}
 
 	minor_slice_iterator minor_slice_end()
 	{
-		return minor_slice_iterator( this, minor_size_ );
+		return minor_slice_iterator( this, major_size_ );
 	}
 
 	const_minor_slice_iterator minor_slice_end() const
 	{
-		return const_minor_slice_iterator( this, minor_size_ );
+		return const_minor_slice_iterator( this, major_size_ );
 	}
 
 	const_minor_slice_iterator minor_slice_cend() const
 	{
-		return const_minor_slice_iterator( this, minor_size_ );
+		return const_minor_slice_iterator( this, major_size_ );
 	}
 
 
 #pragma endregion
 
+#pragma region Selection
+public:
+	// New array holding the rows (columns) whose mask entry is true, in order.
+	// The mask needs rows() (cols()) entries convertible to bool; another
+	// length throws std::invalid_argument. It is turned into an index list
+	// once; slices along the major axis are then copied as contiguous blocks,
+	// along the minor axis every major slice is gathered through the same
+	// index list.
+	template< typename Mask >
+	array2d select_rows( const Mask& mask ) const
+	{
+		return _take( _mask_to_indices( mask, rows() ), row_tag() );
+	}
+
+	template< typename Mask >
+	array2d select_cols( const Mask& mask ) const
+	{
+		return _take( _mask_to_indices( mask, cols() ), column_tag() );
+	}
+
+	// As select_rows/select_cols with the mask given by pred( slice ).
+	template< typename Predicate >
+	array2d select_rows_if( Predicate pred ) const
+	{
+		std::vector< size_type > indices;
+		size_type index = 0;
+		for( auto row : row_seq() ) {
+			if( pred( row ) ) {
+				indices.push_back( index );
+			}
+			++index;
+		}
+		return _take( indices, row_tag() );
+	}
+
+	template< typename Predicate >
+	array2d select_cols_if( Predicate pred ) const
+	{
+		std::vector< size_type > indices;
+		size_type index = 0;
+		for( auto col : col_seq() ) {
+			if( pred( col ) ) {
+				indices.push_back( index );
+			}
+			++index;
+		}
+		return _take( indices, column_tag() );
+	}
+
+	// New array holding the rows (columns) at the given positions, in order,
+	// e.g. an argsort permutation or a sample. indices is an na_vector of an
+	// integral type; NA and out-of-range positions give a row (column) of NA.
+	template< typename IndexVector >
+	array2d take_rows( const IndexVector& indices ) const
+	{
+		return _take_checked( na::detail::resolve_indices( indices, rows() ), row_tag() );
+	}
+
+	template< typename IndexVector >
+	array2d take_cols( const IndexVector& indices ) const
+	{
+		return _take_checked( na::detail::resolve_indices( indices, cols() ), column_tag() );
+	}
+#pragma endregion
+
+#pragma region Element Visitation
+public:
+	// Calls f( row, col, value ) for every element, walking data() in storage
+	// order and skipping the unused tail of each major slice. Without such a
+	// gap the whole array is one contiguous loop; when f ignores the
+	// position, the position bookkeeping folds away and the loop vectorizes.
+	template< typename Function >
+	Function for_each_element( Function f )
+	{
+		_visit_elements( data(), f );
+		return f;
+	}
+
+	template< typename Function >
+	Function for_each_element( Function f ) const
+	{
+		_visit_elements( data(), f );
+		return f;
+	}
+
+	// Replaces every element by f( row, col, value ), in storage order.
+	template< typename Function >
+	void transform_elements( Function f )
+	{
+		auto assign = [&f]( size_type row, size_type col, value_type& val ) {
+			val = f( row, col, const_cast< const value_type& >( val ) );
+		};
+		_visit_elements( data(), assign );
+	}
+#pragma endregion
+
 #pragma region Internal
 private:
 	friend col_element_iterator;
@@ -806,7 +1177,7 @@ private:
 
 	const_major_slice_iterator get_slice_begin( tags::major_tag ) const
 	{
-		return const_major_slice_begin();
+		return major_slice_cbegin();
 	}
 
 	minor_slice_iterator get_slice_begin( tags::minor_tag )
@@ -839,24 +1210,119 @@ private:
 		return minor_slice_cend();
 	}
 	
+	template< typename Mask >
+	static std::vector< size_type > _mask_to_indices( const Mask& mask, size_type count )
+	{
+		return na::detail::mask_positions( mask, count );
+	}
+
+	// (rows, cols) of an array with the given major extent and number of major slices
+	std::pair< size_type, size_type > _to_rows_cols( size_type major, size_type minor ) const
+	{
+		// the mapping is a plain swap (or none), so it is its own inverse
+		return _to_major_minor( major, minor, OrderType() );
+	}
+
+	// New array made of the given major slices, in the given order: one block
+	// copy per slice.
+	array2d _take( const std::vector< size_type >& indices, tags::major_tag ) const
+	{
+		auto shape = _to_rows_cols( major_size_, indices.size() );
+		array2d result( shape.first, shape.second );
+
+		for( size_type k = 0; k < indices.size(); ++k ) {
+			const value_type* src = data() + indices[k] * major_max_;
+			std::copy( src, src + major_size_, result.data() + k * result.major_max_ );
+		}
+		return result;
+	}
+
+	// New array made of the given minor slices: every major slice is gathered
+	// through the index list.
+	array2d _take( const std::vector< size_type >& indices, tags::minor_tag ) const
+	{
+		auto shape = _to_rows_cols( indices.size(), minor_size_ );
+		array2d result( shape.first, shape.second );
+
+		const size_type* index = indices.data();
+		const size_type count = indices.size();
+		for( size_type i = 0; i < minor_size_; ++i ) {
+			const value_type* src = data() + i * major_max_;
+			value_type* dst = result.data() + i * result.major_max_;
+			for( size_type k = 0; k < count; ++k ) {
+				dst[k] = src[ index[k] ];
+			}
+		}
+		return result;
+	}
+
+	// As _take, with invalid positions producing NA slices (elements).
+	array2d _take_checked( const std::vector< size_type >& indices, tags::major_tag ) const
+	{
+		auto shape = _to_rows_cols( major_size_, indices.size() );
+		array2d result( shape.first, shape.second );
+
+		for( size_type k = 0; k < indices.size(); ++k ) {
+			value_type* dst = result.data() + k * result.major_max_;
+			if( k + 1 < indices.size() && indices[k+1] < minor_size_ ) {
+				NA_PREFETCH( data() + indices[k+1] * major_max_ );
+			}
+			if( indices[k] < minor_size_ ) {
+				const value_type* src = data() + indices[k] * major_max_;
+				std::copy( src, src + major_size_, dst );
+			} else {
+				std::fill( dst, dst + major_size_, ContainerType::get_na() );
+			}
+		}
+		return result;
+	}
+
+	array2d _take_checked( const std::vector< size_type >& indices, tags::minor_tag ) const
+	{
+		auto shape = _to_rows_cols( indices.size(), minor_size_ );
+		array2d result( shape.first, shape.second );
+
+		for( size_type i = 0; i < minor_size_; ++i ) {
+			na::detail::gather( result.data() + i * result.major_max_, data() + i * major_max_, major_size_,
+								indices.data(), indices.size(), ContainerType::get_na() );
+		}
+		return result;
+	}
+
 	major_element_iterator _get_element_begin( size_type index, tags::major_tag )
 	{
+#ifdef NA_ARRAY2D_PROFILE
+		return major_element_iterator( data() + index * major_max_, &profile_ );
+#else
 		return major_element_iterator( data() + index * major_max_ );
+#endif
 	}
 
 	const_major_element_iterator _get_element_begin( size_type index, tags::major_tag ) const
 	{
-		return major_element_iterator( data() + index * major_max_ );
+#ifdef NA_ARRAY2D_PROFILE
+		return const_major_element_iterator( data() + index * major_max_, &profile_ );
+#else
+		return const_major_element_iterator( data() + index * major_max_ );
+#endif
 	}
 
 	minor_element_iterator _get_element_begin( size_type index, tags::minor_tag )
 	{
+#ifdef NA_ARRAY2D_PROFILE
+		return minor_element_iterator( data() + index, _stride(), &profile_ );
+#else
 		return minor_element_iterator( data() + index, _stride() );
+#endif
 	}
 
 	const_minor_element_iterator _get_element_begin( size_type index, tags::minor_tag ) const
 	{
+#ifdef NA_ARRAY2D_PROFILE
+		return const_minor_element_iterator( data() + index, _stride(), &profile_ );
+#else
 		return const_minor_element_iterator( data() + index, _stride() );
+#endif
 	}
 
 	major_element_iterator _get_element_end( size_type index, tags::major_tag )
@@ -866,7 +1332,7 @@ private:
 
 	const_major_element_iterator _get_element_end( size_type index, tags::major_tag ) const
 	{
-		return major_element_iterator( data() + index * major_max_ + major_site_ );
+		return const_major_element_iterator( data() + index * major_max_ + major_size_ );
 	}
 
 	minor_element_iterator _get_element_end( size_type index, tags::minor_tag )
@@ -880,4 +1346,58 @@ private:
 	}
 #pragma endregion
 
-};
\ No newline at end of file
+};
+
+namespace na {
+
+	namespace detail {
+
+		template< typename Array >
+		void complete_mask( const Array& arr, tags::major_tag, std::vector< bool >& mask )
+		{
+			typedef typename array_policy< Array >::type policy;
+			for( std::size_t i = 0; i < arr.minor_size(); ++i ) {
+				const typename Array::value_type* slice = arr.data() + i * arr.stride();
+				bool complete = true;
+				for( std::size_t j = 0; j < arr.major_size(); ++j ) {
+					complete &= !policy::is_na( slice[j] );
+				}
+				mask[i] = complete;
+			}
+		}
+
+		template< typename Array >
+		void complete_mask( const Array& arr, tags::minor_tag, std::vector< bool >& mask )
+		{
+			typedef typename array_policy< Array >::type policy;
+			std::vector< char > complete( arr.major_size(), 1 );
+			for( std::size_t i = 0; i < arr.minor_size(); ++i ) {
+				const typename Array::value_type* slice = arr.data() + i * arr.stride();
+				for( std::size_t j = 0; j < arr.major_size(); ++j ) {
+					complete[j] &= policy::is_na( slice[j] ) ? 0 : 1;
+				}
+			}
+			std::copy( complete.begin(), complete.end(), mask.begin() );
+		}
+
+	}
+
+	// Mask of the rows (columns) without any NA, computed in one pass in
+	// storage order; meant for select_rows/select_cols.
+	template< typename Array >
+	std::vector< bool > complete_rows( const Array& arr )
+	{
+		std::vector< bool > mask( arr.rows() );
+		detail::complete_mask( arr, typename Array::row_tag(), mask );
+		return mask;
+	}
+
+	template< typename Array >
+	std::vector< bool > complete_cols( const Array& arr )
+	{
+		std::vector< bool > mask( arr.cols() );
+		detail::complete_mask( arr, typename Array::column_tag(), mask );
+		return mask;
+	}
+
+}
@@ -0,0 +1,507 @@
+#pragma once
+#include <na_containers/na_vector.h>
+#include <na_containers/array2d.h>
+#include <algorithm>
+#include <boost/iterator/iterator_facade.hpp>
+
+namespace detail {
+
+	// Element iterator with the stride baked into the type.
+	template< typename ValueType, std::size_t Stride >
+	class fixed_element_iterator
+		: public boost::iterator_facade< fixed_element_iterator< ValueType, Stride >,
+										 ValueType,
+										 std::random_access_iterator_tag >
+	{
+	public:
+		typedef typename fixed_element_iterator::iterator_facade_::reference reference;
+		typedef typename fixed_element_iterator::iterator_facade_::difference_type difference_type;
+
+		fixed_element_iterator()
+			: ptr_( nullptr )
+		{
+		}
+
+		explicit fixed_element_iterator( ValueType* ptr )
+			: ptr_( ptr )
+		{
+		}
+
+		operator fixed_element_iterator< const ValueType, Stride >() const
+		{
+			return fixed_element_iterator< const ValueType, Stride >( ptr_ );
+		}
+
+		reference dereference() const
+		{
+			return *ptr_;
+		}
+
+		void increment()
+		{
+			ptr_ += Stride;
+		}
+
+		void decrement()
+		{
+			ptr_ -= Stride;
+		}
+
+		bool equal( const fixed_element_iterator& other ) const
+		{
+			return ptr_ == other.ptr_;
+		}
+
+		difference_type distance_to( const fixed_element_iterator& other ) const
+		{
+			return (other.ptr_ - ptr_) / difference_type(Stride);
+		}
+
+		void advance( difference_type diff )
+		{
+			ptr_ += diff * difference_type(Stride);
+		}
+
+	private:
+		ValueType* ptr_;
+	};
+
+	// A row or column of an array2d_fixed: Length elements, Stride apart.
+	template< typename ValueType, std::size_t Stride, std::size_t Length >
+	class fixed_slice_type {
+	public:
+		typedef fixed_element_iterator< ValueType, Stride > iterator;
+		typedef fixed_element_iterator< const ValueType, Stride > const_iterator;
+		typedef ValueType value_type;
+		typedef std::size_t size_type;
+
+		explicit fixed_slice_type( ValueType* first )
+			: first_( first )
+		{
+		}
+
+		operator fixed_slice_type< const ValueType, Stride, Length >() const
+		{
+			return fixed_slice_type< const ValueType, Stride, Length >( first_ );
+		}
+
+		static size_type size()
+		{
+			return Length;
+		}
+
+		iterator begin() const
+		{
+			return iterator( first_ );
+		}
+
+		iterator end() const
+		{
+			return iterator( first_ + Stride * Length );
+		}
+
+		const_iterator cbegin() const
+		{
+			return begin();
+		}
+
+		const_iterator cend() const
+		{
+			return end();
+		}
+
+		value_type& operator[]( size_type index ) const
+		{
+			return first_[ index * Stride ];
+		}
+
+	private:
+		ValueType* first_;
+	};
+
+	// Iterates the slices of one kind; SliceStride is the distance between
+	// the first elements of neighbouring slices.
+	template< typename ValueType, std::size_t SliceStride, std::size_t ElementStride, std::size_t Length >
+	class fixed_slice_iterator
+		: public boost::iterator_facade< fixed_slice_iterator< ValueType, SliceStride, ElementStride, Length >,
+										 fixed_slice_type< ValueType, ElementStride, Length >,
+										 std::random_access_iterator_tag,
+										 fixed_slice_type< ValueType, ElementStride, Length > >
+	{
+	public:
+		typedef typename fixed_slice_iterator::iterator_facade_::reference reference;
+		typedef typename fixed_slice_iterator::iterator_facade_::difference_type difference_type;
+
+		fixed_slice_iterator()
+			: first_( nullptr )
+		{
+		}
+
+		explicit fixed_slice_iterator( ValueType* first )
+			: first_( first )
+		{
+		}
+
+		operator fixed_slice_iterator< const ValueType, SliceStride, ElementStride, Length >() const
+		{
+			return fixed_slice_iterator< const ValueType, SliceStride, ElementStride, Length >( first_ );
+		}
+
+		reference dereference() const
+		{
+			return reference( first_ );
+		}
+
+		void increment()
+		{
+			first_ += SliceStride;
+		}
+
+		void decrement()
+		{
+			first_ -= SliceStride;
+		}
+
+		bool equal( const fixed_slice_iterator& other ) const
+		{
+			return first_ == other.first_;
+		}
+
+		difference_type distance_to( const fixed_slice_iterator& other ) const
+		{
+			return (other.first_ - first_) / difference_type(SliceStride);
+		}
+
+		void advance( difference_type diff )
+		{
+			first_ += diff * difference_type(SliceStride);
+		}
+
+	private:
+		ValueType* first_;
+	};
+
+	template< typename ValueType, std::size_t SliceStride, std::size_t ElementStride, std::size_t Length, std::size_t Count >
+	class fixed_slice_sequence {
+	public:
+		typedef fixed_slice_iterator< ValueType, SliceStride, ElementStride, Length > iterator;
+		typedef fixed_slice_iterator< const ValueType, SliceStride, ElementStride, Length > const_iterator;
+
+		explicit fixed_slice_sequence( ValueType* data )
+			: data_( data )
+		{
+		}
+
+		static std::size_t size()
+		{
+			return Count;
+		}
+
+		iterator begin() const
+		{
+			return iterator( data_ );
+		}
+
+		iterator end() const
+		{
+			return iterator( data_ + SliceStride * Count );
+		}
+
+		const_iterator cbegin() const
+		{
+			return begin();
+		}
+
+		const_iterator cend() const
+		{
+			return end();
+		}
+
+	private:
+		ValueType* data_;
+	};
+
+	// Compile-time layout of a Rows x Cols array: strides between
+	// neighbouring elements of a row and of a column.
+	template< typename OrderType, std::size_t Rows, std::size_t Cols >
+	struct fixed_layout;
+
+	template< std::size_t Rows, std::size_t Cols >
+	struct fixed_layout< order::column_major, Rows, Cols > {
+		static const std::size_t row_stride = 1;
+		static const std::size_t col_stride = Rows;
+		static const std::size_t major_size = Rows;
+		static const std::size_t minor_size = Cols;
+		typedef tags::minor_tag row_tag;
+		typedef tags::major_tag column_tag;
+	};
+
+	template< std::size_t Rows, std::size_t Cols >
+	struct fixed_layout< order::row_major, Rows, Cols > {
+		static const std::size_t row_stride = Cols;
+		static const std::size_t col_stride = 1;
+		static const std::size_t major_size = Cols;
+		static const std::size_t minor_size = Rows;
+		typedef tags::major_tag row_tag;
+		typedef tags::minor_tag column_tag;
+	};
+
+}
+
+// Rows x Cols array with inline storage and compile-time layout. Index
+// arithmetic and slice strides are constants, so loops over rows, columns or
+// elements can be fully unrolled and vectorized; there is no heap allocation.
+//
+// Offers the read/write interface of array2d: dereference, operator[] for
+// columns, row_seq()/col_seq(), row/column slice iterators, the major/minor
+// element layout accessors and data(). Elements start out NA.
+template< typename ValueType, std::size_t Rows, std::size_t Cols,
+		  typename OrderType = order::column_major,
+		  typename NaPolicy = na::policies::NaPolicySV< ValueType > >
+class array2d_fixed {
+	typedef detail::fixed_layout< OrderType, Rows, Cols > layout;
+
+public:
+	typedef NaPolicy policy_type;
+	typedef typename NaPolicy::value_type value_type;
+	typedef value_type& reference;
+	typedef const value_type& const_reference;
+	typedef std::size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef OrderType order_type;
+
+	typedef typename layout::row_tag row_tag;
+	typedef typename layout::column_tag column_tag;
+
+	static const size_type row_count = Rows;
+	static const size_type col_count = Cols;
+	static const size_type row_stride = layout::row_stride;
+	static const size_type col_stride = layout::col_stride;
+
+	// row i starts at i*row_stride, its elements are col_stride apart
+	typedef detail::fixed_slice_type< value_type, layout::col_stride, Cols > row_slice;
+	typedef detail::fixed_slice_type< const value_type, layout::col_stride, Cols > const_row_slice;
+	typedef detail::fixed_slice_type< value_type, layout::row_stride, Rows > column_slice;
+	typedef detail::fixed_slice_type< const value_type, layout::row_stride, Rows > const_column_slice;
+
+	typedef typename row_slice::iterator row_element_iterator;
+	typedef typename const_row_slice::iterator const_row_element_iterator;
+	typedef typename column_slice::iterator col_element_iterator;
+	typedef typename const_column_slice::iterator const_col_element_iterator;
+
+	typedef detail::fixed_slice_iterator< value_type, layout::row_stride, layout::col_stride, Cols > row_slice_iterator;
+	typedef detail::fixed_slice_iterator< const value_type, layout::row_stride, layout::col_stride, Cols > const_row_slice_iterator;
+	typedef detail::fixed_slice_iterator< value_type, layout::col_stride, layout::row_stride, Rows > col_slice_iterator;
+	typedef detail::fixed_slice_iterator< const value_type, layout::col_stride, layout::row_stride, Rows > const_col_slice_iterator;
+
+	typedef detail::fixed_slice_sequence< value_type, layout::row_stride, layout::col_stride, Cols, Rows > row_slice_sequence;
+	typedef detail::fixed_slice_sequence< const value_type, layout::row_stride, layout::col_stride, Cols, Rows > const_row_slice_sequence;
+	typedef detail::fixed_slice_sequence< value_type, layout::col_stride, layout::row_stride, Rows, Cols > column_slice_sequence;
+	typedef detail::fixed_slice_sequence< const value_type, layout::col_stride, layout::row_stride, Rows, Cols > const_column_slice_sequence;
+
+public:
+	array2d_fixed()
+	{
+		std::fill( data_, data_ + Rows * Cols, NaPolicy::get_na() );
+	}
+
+	explicit array2d_fixed( const value_type& val )
+	{
+		std::fill( data_, data_ + Rows * Cols, val );
+	}
+
+public:
+	static value_type get_na()
+	{
+		return NaPolicy::get_na();
+	}
+
+	static size_type rows()
+	{
+		return Rows;
+	}
+
+	static size_type cols()
+	{
+		return Cols;
+	}
+
+	static size_type to_index( size_type row, size_type col )
+	{
+		return row * layout::row_stride + col * layout::col_stride;
+	}
+
+	reference dereference( size_type row, size_type col )
+	{
+		return data_[ to_index( row, col ) ];
+	}
+
+	const_reference dereference( size_type row, size_type col ) const
+	{
+		return data_[ to_index( row, col ) ];
+	}
+
+	column_slice operator[]( size_type col )
+	{
+		return column_slice( data_ + col * layout::col_stride );
+	}
+
+	const_column_slice operator[]( size_type col ) const
+	{
+		return const_column_slice( data_ + col * layout::col_stride );
+	}
+
+	row_slice row( size_type index )
+	{
+		return row_slice( data_ + index * layout::row_stride );
+	}
+
+	const_row_slice row( size_type index ) const
+	{
+		return const_row_slice( data_ + index * layout::row_stride );
+	}
+
+	value_type* data()
+	{
+		return data_;
+	}
+
+	const value_type* data() const
+	{
+		return data_;
+	}
+
+	void swap( array2d_fixed& other )
+	{
+		std::swap_ranges( data_, data_ + Rows * Cols, other.data_ );
+	}
+
+	// Storage layout, as for array2d. The storage is packed.
+	static size_type major_size()
+	{
+		return layout::major_size;
+	}
+
+	static size_type minor_size()
+	{
+		return layout::minor_size;
+	}
+
+	static size_type stride()
+	{
+		return layout::major_size;
+	}
+
+	static size_type major_alignment()
+	{
+		return 1;
+	}
+
+#pragma region Sequences
+public:
+	column_slice_sequence col_seq() {
+		return column_slice_sequence( data_ );
+	}
+
+	const_column_slice_sequence col_seq() const {
+		return const_column_slice_sequence( data_ );
+	}
+
+	row_slice_sequence row_seq() {
+		return row_slice_sequence( data_ );
+	}
+
+	const_row_slice_sequence row_seq() const {
+		return const_row_slice_sequence( data_ );
+	}
+#pragma endregion
+
+#pragma region Slice Iterators
+public:
+	row_slice_iterator row_begin()
+	{
+		return row_seq().begin();
+	}
+
+	row_slice_iterator row_end()
+	{
+		return row_seq().end();
+	}
+
+	const_row_slice_iterator row_begin() const
+	{
+		return row_seq().begin();
+	}
+
+	const_row_slice_iterator row_end() const
+	{
+		return row_seq().end();
+	}
+
+	const_row_slice_iterator row_cbegin() const
+	{
+		return row_seq().begin();
+	}
+
+	const_row_slice_iterator row_cend() const
+	{
+		return row_seq().end();
+	}
+
+	col_slice_iterator col_begin()
+	{
+		return col_seq().begin();
+	}
+
+	col_slice_iterator col_end()
+	{
+		return col_seq().end();
+	}
+
+	const_col_slice_iterator col_begin() const
+	{
+		return col_seq().begin();
+	}
+
+	const_col_slice_iterator col_end() const
+	{
+		return col_seq().end();
+	}
+
+	const_col_slice_iterator col_cbegin() const
+	{
+		return col_seq().begin();
+	}
+
+	const_col_slice_iterator col_cend() const
+	{
+		return col_seq().end();
+	}
+#pragma endregion
+
+private:
+	value_type data_[ Rows * Cols ];
+};
+
+template< typename ValueType, std::size_t Rows, std::size_t Cols, typename OrderType, typename NaPolicy >
+const std::size_t array2d_fixed< ValueType, Rows, Cols, OrderType, NaPolicy >::row_count;
+
+template< typename ValueType, std::size_t Rows, std::size_t Cols, typename OrderType, typename NaPolicy >
+const std::size_t array2d_fixed< ValueType, Rows, Cols, OrderType, NaPolicy >::col_count;
+
+template< typename ValueType, std::size_t Rows, std::size_t Cols, typename OrderType, typename NaPolicy >
+const std::size_t array2d_fixed< ValueType, Rows, Cols, OrderType, NaPolicy >::row_stride;
+
+template< typename ValueType, std::size_t Rows, std::size_t Cols, typename OrderType, typename NaPolicy >
+const std::size_t array2d_fixed< ValueType, Rows, Cols, OrderType, NaPolicy >::col_stride;
+
+namespace na {
+	namespace detail {
+
+		template< typename ValueType, std::size_t Rows, std::size_t Cols, typename OrderType, typename NaPolicy >
+		struct array_policy< array2d_fixed< ValueType, Rows, Cols, OrderType, NaPolicy > > {
+			typedef NaPolicy type;
+		};
+
+	}
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+// Access profiling for array2d, enabled by defining NA_ARRAY2D_PROFILE
+// before including any na_containers header (best project wide).
+//
+// A profiled array2d counts how it is traversed: slices handed out by major
+// and minor slice iterators, elements visited through contiguous (major) and
+// strided (minor) element iterators, and dereference( row, col ) calls, split
+// by whether each call stepped to the neighbouring element in memory, one
+// stride away, or elsewhere. When the array is destroyed it writes a summary
+// to std::clog and suggests the other order:: when most of the element
+// visits ran across the storage order.
+//
+// Without NA_ARRAY2D_PROFILE nothing of this is compiled in and the hooks in
+// array2d expand to nothing.
+
+#ifdef NA_ARRAY2D_PROFILE
+
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+
+namespace order {
+	struct row_major;
+	struct column_major;
+}
+
+namespace tags {
+	struct major_tag;
+	struct minor_tag;
+}
+
+namespace na {
+	namespace detail {
+
+		struct access_counters {
+			std::atomic< std::size_t > major_slices;
+			std::atomic< std::size_t > minor_slices;
+			std::atomic< std::size_t > major_elements;
+			std::atomic< std::size_t > minor_elements;
+			std::atomic< std::size_t > dereferences;
+			std::atomic< std::size_t > dereferences_contiguous;
+			std::atomic< std::size_t > dereferences_strided;
+
+			access_counters()
+			{
+				reset();
+			}
+
+			// A copy of an array starts a profile of its own.
+			access_counters( const access_counters& )
+			{
+				reset();
+			}
+
+			void reset()
+			{
+				major_slices = 0;
+				minor_slices = 0;
+				major_elements = 0;
+				minor_elements = 0;
+				dereferences = 0;
+				dereferences_contiguous = 0;
+				dereferences_strided = 0;
+				last_index_ = -1;
+			}
+
+			void count_slice( const tags::major_tag& )
+			{
+				++major_slices;
+			}
+
+			void count_slice( const tags::minor_tag& )
+			{
+				++minor_slices;
+			}
+
+			void count_dereference( std::ptrdiff_t index, std::ptrdiff_t stride )
+			{
+				const std::ptrdiff_t last = last_index_.exchange( index, std::memory_order_relaxed );
+				const std::ptrdiff_t step = index - last;
+				++dereferences;
+				if( last < 0 ) {
+					return;
+				}
+				if( step == 1 || step == -1 ) {
+					++dereferences_contiguous;
+				} else if( step == stride || step == -stride ) {
+					++dereferences_strided;
+				}
+			}
+
+			// Element visits that walked along the storage order and across it.
+			std::size_t contiguous_visits() const
+			{
+				return major_elements + dereferences_contiguous;
+			}
+
+			std::size_t strided_visits() const
+			{
+				return minor_elements + dereferences_strided;
+			}
+
+		private:
+			access_counters& operator=( const access_counters& );
+
+			std::atomic< std::ptrdiff_t > last_index_;
+		};
+
+		template< typename OrderType >
+		struct order_names;
+
+		template<>
+		struct order_names< order::row_major > {
+			static const char* self()  { return "order::row_major"; }
+			static const char* other() { return "order::column_major"; }
+		};
+
+		template<>
+		struct order_names< order::column_major > {
+			static const char* self()  { return "order::column_major"; }
+			static const char* other() { return "order::row_major"; }
+		};
+
+		// The counters of one array2d; reports when the array goes away.
+		template< typename OrderType >
+		class access_profile : public access_counters {
+		public:
+			~access_profile()
+			{
+				const std::size_t contiguous = contiguous_visits();
+				const std::size_t strided = strided_visits();
+				if( contiguous + strided + dereferences + major_slices + minor_slices == 0 ) {
+					return;
+				}
+
+				std::clog << "array2d<" << order_names< OrderType >::self() << "> at " << static_cast< const void* >( this ) << " access profile:\n"
+						  << "  slices:        " << major_slices << " major, " << minor_slices << " minor\n"
+						  << "  elements:      " << major_elements << " contiguous, " << minor_elements << " strided\n"
+						  << "  dereference(): " << dereferences << " (" << dereferences_contiguous << " contiguous, "
+						  << dereferences_strided << " strided, " << (dereferences - dereferences_contiguous - dereferences_strided) << " other)\n";
+
+				if( strided > contiguous ) {
+					std::clog << "  hint: " << strided << " of " << (strided + contiguous)
+							  << " sequential element visits ran across the storage order; "
+							  << order_names< OrderType >::other() << " would make them contiguous\n";
+				}
+			}
+		};
+
+	}
+}
+
+#define NA_PROFILE_COUNT( counters, counter ) do { if( counters ) { ++(counters)->counter; } } while( false )
+#define NA_PROFILE_SLICE( profile, tag ) (profile).count_slice( tag )
+#define NA_PROFILE_DEREFERENCE( profile, index, stride ) (profile).count_dereference( std::ptrdiff_t( index ), std::ptrdiff_t( stride ) )
+
+#else
+
+#define NA_PROFILE_COUNT( counters, counter ) ((void)0)
+#define NA_PROFILE_SLICE( profile, tag ) ((void)0)
+#define NA_PROFILE_DEREFERENCE( profile, index, stride ) ((void)0)
+
+#endif
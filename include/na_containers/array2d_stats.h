@@ -0,0 +1,249 @@
+#pragma once
+#include <na_containers/na_vector.h>
+#include <na_containers/array2d.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+// Per-slice descriptive statistics in a single pass over the storage.
+//
+// column_stats() and row_stats() never walk a strided slice. Statistics of
+// major slices are computed slice by slice over contiguous memory; statistics
+// of minor slices keep one accumulator per slice and update all of them while
+// walking each contiguous major slice, so the whole array is read once in
+// storage order either way.
+//
+// Sums are kept relative to a per-slice shift that follows the running mean
+// and are merged block-wise, which keeps the variance accurate without a
+// division in the inner loop.
+
+namespace na {
+
+	template< typename ValueType >
+	struct slice_stats {
+		typedef ValueType value_type;
+
+		std::size_t count;		// non-NA elements
+		std::size_t na_count;
+		double sum;
+		double mean;			// NaN if count == 0
+		double variance;		// sample variance, NaN if count < 2
+		value_type min;			// NA if count == 0
+		value_type max;			// NA if count == 0
+	};
+
+	namespace detail {
+
+		const std::size_t stats_block_size = 256;
+
+		template< typename Policy >
+		class stats_accumulator {
+		public:
+			typedef typename Policy::value_type value_type;
+			typedef na_value_traits< value_type > traits;
+			typedef typename traits::raw_type raw_type;
+
+			explicit stats_accumulator( std::size_t lanes )
+				: lanes_( lanes ), length_( 0 ),
+				  n_( lanes, 0.0 ), mean_( lanes, 0.0 ), m2_( lanes, 0.0 ), sum_( lanes, 0.0 ),
+				  shift_( lanes, 0.0 ), shifted_( lanes, 0 ), unshifted_( lanes ),
+				  block_count_( lanes ), block_sum_( lanes ), block_sq_( lanes ),
+				  min_( lanes, (std::numeric_limits< raw_type >::max)() ),
+				  max_( lanes, std::numeric_limits< raw_type >::is_integer ? (std::numeric_limits< raw_type >::min)() : -(std::numeric_limits< raw_type >::max)() )
+			{
+				_reset_block();
+			}
+
+			// Adds one element to every lane; element j is at slice[j].
+			void add( const value_type* slice )
+			{
+				if( unshifted_ ) {
+					_init_shift( slice );
+				}
+
+				for( std::size_t j = 0; j < lanes_; ++j ) {
+					const bool na = Policy::is_na( slice[j] );
+					const raw_type raw = na ? raw_type() : traits::get( slice[j] );
+					const double v = na ? 0.0 : double(raw) - shift_[j];
+					block_count_[j] += na ? 0 : 1;
+					block_sum_[j]   += v;
+					block_sq_[j]    += v * v;
+					min_[j] = (!na && raw < min_[j]) ? raw : min_[j];
+					max_[j] = (!na && raw > max_[j]) ? raw : max_[j];
+				}
+
+				if( ++length_ % stats_block_size == 0 ) {
+					_merge_block();
+				}
+			}
+
+			// Adds length elements of a single lane, stored contiguously.
+			void add_contiguous( const value_type* data, std::size_t length )
+			{
+				for( std::size_t i = 0; unshifted_ && i < length; ++i ) {
+					_init_shift( data + i );
+				}
+
+				while( length ) {
+					const std::size_t block = std::min( length, stats_block_size - length_ % stats_block_size );
+					const double shift = shift_[0];
+					std::size_t count = 0;
+					double sum = 0.0, sq = 0.0;
+					raw_type lo = min_[0], hi = max_[0];
+
+					for( std::size_t i = 0; i < block; ++i ) {
+						const bool na = Policy::is_na( data[i] );
+						const raw_type raw = na ? raw_type() : traits::get( data[i] );
+						const double v = na ? 0.0 : double(raw) - shift;
+						count += na ? 0 : 1;
+						sum   += v;
+						sq    += v * v;
+						lo = (!na && raw < lo) ? raw : lo;
+						hi = (!na && raw > hi) ? raw : hi;
+					}
+
+					block_count_[0] += count;
+					block_sum_[0]   += sum;
+					block_sq_[0]    += sq;
+					min_[0] = lo;
+					max_[0] = hi;
+
+					data    += block;
+					length  -= block;
+					length_ += block;
+					if( length_ % stats_block_size == 0 ) {
+						_merge_block();
+					}
+				}
+			}
+
+			void finish( std::vector< slice_stats< value_type > >& result )
+			{
+				_merge_block();
+
+				const double nan = std::numeric_limits< double >::quiet_NaN();
+				for( std::size_t j = 0; j < lanes_; ++j ) {
+					slice_stats< value_type > stats;
+					stats.count    = std::size_t( n_[j] );
+					stats.na_count = length_ - stats.count;
+					stats.sum      = sum_[j];
+					stats.mean     = stats.count ? mean_[j] : nan;
+					stats.variance = stats.count > 1 ? m2_[j] / (n_[j] - 1.0) : nan;
+					stats.min      = stats.count ? traits::make( min_[j] ) : Policy::get_na();
+					stats.max      = stats.count ? traits::make( max_[j] ) : Policy::get_na();
+					result.push_back( stats );
+				}
+			}
+
+		private:
+			// Until its first merge, a lane is taken relative to its first non-NA
+			// element. Leading NAs add nothing to the block, so the shift can be
+			// set late; an unshifted block would cancel catastrophically in
+			// block_sq - block_sum^2/n for data with a large offset.
+			void _init_shift( const value_type* slice )
+			{
+				for( std::size_t j = 0; j < lanes_; ++j ) {
+					if( !shifted_[j] && !Policy::is_na( slice[j] ) ) {
+						shift_[j]   = double( traits::get( slice[j] ) );
+						shifted_[j] = 1;
+						--unshifted_;
+					}
+				}
+			}
+
+			void _reset_block()
+			{
+				std::fill( block_count_.begin(), block_count_.end(), std::size_t(0) );
+				std::fill( block_sum_.begin(), block_sum_.end(), 0.0 );
+				std::fill( block_sq_.begin(), block_sq_.end(), 0.0 );
+			}
+
+			// Chan et al. pairwise update of (n, mean, M2) with the block.
+			void _merge_block()
+			{
+				for( std::size_t j = 0; j < lanes_; ++j ) {
+					const double nb = double( block_count_[j] );
+					if( nb == 0.0 ) {
+						continue;
+					}
+					const double mean_b = shift_[j] + block_sum_[j] / nb;
+					const double m2_b   = std::max( block_sq_[j] - block_sum_[j] * block_sum_[j] / nb, 0.0 );
+					const double n      = n_[j] + nb;
+					const double delta  = mean_b - mean_[j];
+
+					m2_[j]   += m2_b + delta * delta * n_[j] * nb / n;
+					mean_[j] += delta * nb / n;
+					sum_[j]  += shift_[j] * nb + block_sum_[j];
+					n_[j]     = n;
+					shift_[j] = mean_[j];
+				}
+				_reset_block();
+			}
+
+			std::size_t lanes_;
+			std::size_t length_;
+
+			std::vector< double > n_, mean_, m2_, sum_, shift_;
+			std::vector< char > shifted_;
+			std::size_t unshifted_;
+			std::vector< std::size_t > block_count_;
+			std::vector< double > block_sum_, block_sq_;
+			std::vector< raw_type > min_, max_;
+		};
+
+		template< typename Array >
+		void slice_stats_impl( const Array& arr, tags::major_tag, std::vector< slice_stats< typename Array::value_type > >& result )
+		{
+			typedef typename array_policy< Array >::type policy;
+			for( std::size_t i = 0; i < arr.minor_size(); ++i ) {
+				stats_accumulator< policy > acc( 1 );
+				acc.add_contiguous( arr.data() + i * arr.stride(), arr.major_size() );
+				acc.finish( result );
+			}
+		}
+
+		template< typename Array >
+		void slice_stats_impl( const Array& arr, tags::minor_tag, std::vector< slice_stats< typename Array::value_type > >& result )
+		{
+			typedef typename array_policy< Array >::type policy;
+			stats_accumulator< policy > acc( arr.major_size() );
+			for( std::size_t i = 0; i < arr.minor_size(); ++i ) {
+				acc.add( arr.data() + i * arr.stride() );
+			}
+			acc.finish( result );
+		}
+
+	}
+
+	// Statistics of every column, in column order.
+	template< typename Array >
+	std::vector< slice_stats< typename Array::value_type > > column_stats( const Array& arr )
+	{
+		std::vector< slice_stats< typename Array::value_type > > result;
+		result.reserve( arr.cols() );
+		detail::slice_stats_impl( arr, typename Array::column_tag(), result );
+		return result;
+	}
+
+	// Statistics of every row, in row order.
+	template< typename Array >
+	std::vector< slice_stats< typename Array::value_type > > row_stats( const Array& arr )
+	{
+		std::vector< slice_stats< typename Array::value_type > > result;
+		result.reserve( arr.rows() );
+		detail::slice_stats_impl( arr, typename Array::row_tag(), result );
+		return result;
+	}
+
+	// Statistics of a whole na_vector.
+	template< typename Vector >
+	slice_stats< typename Vector::value_type > vector_stats( const Vector& vec )
+	{
+		std::vector< slice_stats< typename Vector::value_type > > result;
+		detail::stats_accumulator< typename Vector::policy_type > acc( 1 );
+		acc.add_contiguous( vec.data(), vec.size() );
+		acc.finish( result );
+		return result.front();
+	}
+
+}
@@ -0,0 +1,353 @@
+#pragma once
+#include <na_containers/na_vector.h>
+#include <atomic>
+
+namespace na {
+
+	// Copy-on-write wrapper around an na_vector (or any vector-like container).
+	//
+	// Copies share one buffer; the first mutating access through a copy that
+	// is not the only owner clones the buffer first ("detach"). Every non-const
+	// member counts as mutating, including begin(), data() and operator[], so
+	// read-mostly code should go through a const reference to avoid detaching.
+	//
+	// cow_vector provides the container interface array2d relies on, so
+	// array2d< cow_vector< na_vector<...> > > gets cheap copies as well: writes
+	// through dereference(), slices and element iterators all end up in the
+	// non-const data() and detach there.
+	//
+	// Pointers, references and iterators obtained before a copy was made still
+	// point into the shared buffer; take them after copying.
+	//
+	// Each cow_vector object must be used by one thread at a time, but copies
+	// sharing a buffer may live on different threads. The buffer keeps its own
+	// owner count: releasing a copy decrements it with release semantics and
+	// the sharing check loads it with acquire semantics, so a writer that finds
+	// itself the only owner sees every access made through the released copies.
+	template< typename Vector >
+	class cow_vector {
+	public:
+		typedef Vector vector_type;
+		typedef typename Vector::policy_type policy_type;
+		typedef typename Vector::value_type value_type;
+		typedef typename Vector::reference reference;
+		typedef typename Vector::const_reference const_reference;
+		typedef typename Vector::allocator_type allocator_type;
+		typedef typename Vector::size_type size_type;
+		typedef typename Vector::difference_type difference_type;
+		typedef typename Vector::iterator iterator;
+		typedef typename Vector::const_iterator const_iterator;
+		typedef typename Vector::reverse_iterator reverse_iterator;
+		typedef typename Vector::const_reverse_iterator const_reverse_iterator;
+
+	public:
+		static value_type get_na() {
+			return Vector::get_na();
+		}
+
+	public:
+		cow_vector()
+			: data_( new buffer( Vector() ) )
+		{
+		}
+
+		explicit cow_vector( size_type n )
+			: data_( new buffer( Vector( n ) ) )
+		{
+		}
+
+		cow_vector( size_type n, const value_type& val )
+			: data_( new buffer( Vector( n, val ) ) )
+		{
+		}
+
+		explicit cow_vector( const Vector& x )
+			: data_( new buffer( Vector( x ) ) )
+		{
+		}
+
+		explicit cow_vector( Vector&& x )
+			: data_( new buffer( std::move( x ) ) )
+		{
+		}
+
+		cow_vector( const cow_vector& x )
+			: data_( _acquire( x.data_ ) )
+		{
+		}
+
+		cow_vector( cow_vector&& x )
+			: data_( x.data_ )
+		{
+			x.data_ = new buffer( Vector() );
+		}
+
+		~cow_vector()
+		{
+			_release( data_ );
+		}
+
+		cow_vector& operator=( const cow_vector& x )
+		{
+			buffer* old = data_;
+			data_ = _acquire( x.data_ );
+			_release( old );
+			return *this;
+		}
+
+		cow_vector& operator=( cow_vector&& x )
+		{
+			std::swap( data_, x.data_ );
+			return *this;
+		}
+
+		// sharing
+	public:
+		bool is_shared() const
+		{
+			return data_->owners.load( std::memory_order_acquire ) > 1;
+		}
+
+		bool shares_with( const cow_vector& x ) const
+		{
+			return data_ == x.data_;
+		}
+
+		// Makes this the only owner of its buffer.
+		void detach()
+		{
+			if( is_shared() ) {
+				buffer* old = data_;
+				data_ = new buffer( Vector( old->vec ) );
+				_release( old );
+			}
+		}
+
+		const Vector& get() const
+		{
+			return data_->vec;
+		}
+
+		Vector& get()
+		{
+			detach();
+			return data_->vec;
+		}
+
+	public:
+		iterator begin() {
+			return get().begin();
+		}
+
+		iterator end() {
+			return get().end();
+		}
+
+		const_iterator begin() const {
+			return data_->vec.begin();
+		}
+
+		const_iterator end() const {
+			return data_->vec.end();
+		}
+
+		const_iterator cbegin() const {
+			return data_->vec.begin();
+		}
+
+		const_iterator cend() const {
+			return data_->vec.end();
+		}
+
+		reverse_iterator rbegin() {
+			return get().rbegin();
+		}
+
+		reverse_iterator rend() {
+			return get().rend();
+		}
+
+		const_reverse_iterator rbegin() const {
+			return data_->vec.rbegin();
+		}
+
+		const_reverse_iterator rend() const {
+			return data_->vec.rend();
+		}
+
+		const_reference operator[]( size_type index ) const
+		{
+			return data_->vec[index];
+		}
+
+		reference operator[]( size_type index )
+		{
+			return get()[index];
+		}
+
+		void push_back( const_reference val )
+		{
+			get().push_back( val );
+		}
+
+		void push_back( detail::_na_type ) {
+			get().push_back( NA );
+		}
+
+		void pop_back()
+		{
+			get().pop_back();
+		}
+
+		template <class InputIterator>
+		void assign (InputIterator first, InputIterator last)
+		{
+			_replace().assign( first, last );
+		}
+
+		void assign (size_type n, const value_type& val)
+		{
+			_replace().assign( n, val );
+		}
+
+		void assign (size_type n, const detail::_na_type& val)
+		{
+			_replace().assign( n, val );
+		}
+
+		void swap( cow_vector& x )
+		{
+			std::swap( data_, x.data_ );
+		}
+
+		size_type size() const
+		{
+			return data_->vec.size();
+		}
+
+		size_type max_size() const
+		{
+			return data_->vec.max_size();
+		}
+
+		void resize (size_type n)
+		{
+			if( n != size() ) {
+				get().resize( n );
+			}
+		}
+
+		void resize (size_type n, const value_type& val)
+		{
+			if( n != size() ) {
+				get().resize( n, val );
+			}
+		}
+
+		void resize (size_type n, const detail::_na_type& val)
+		{
+			if( n != size() ) {
+				get().resize( n, val );
+			}
+		}
+
+		void resize (size_type n, const value_type& val, const parallel_t& par)
+		{
+			if( n != size() ) {
+				get().resize( n, val, par );
+			}
+		}
+
+		void resize (size_type n, const detail::_na_type& val, const parallel_t& par)
+		{
+			if( n != size() ) {
+				get().resize( n, val, par );
+			}
+		}
+
+		void resize_default_init (size_type n)
+		{
+			if( n != size() ) {
+				get().resize_default_init( n );
+			}
+		}
+
+		void reserve (size_type n)
+		{
+			if( n > capacity() ) {
+				get().reserve( n );
+			}
+		}
+
+		void shrink_to_fit()
+		{
+			get().shrink_to_fit();
+		}
+
+		value_type* data()
+		{
+			return get().data();
+		}
+
+		const value_type* data() const
+		{
+			return data_->vec.data();
+		}
+
+		bool empty() const
+		{
+			return data_->vec.empty();
+		}
+
+		void clear()
+		{
+			_replace();
+		}
+
+		size_type capacity() const
+		{
+			return data_->vec.capacity();
+		}
+
+	private:
+		struct buffer {
+			explicit buffer( Vector&& x )
+				: vec( std::move( x ) ), owners( 1 )
+			{
+			}
+
+			Vector vec;
+			std::atomic< std::size_t > owners;
+		};
+
+		static buffer* _acquire( buffer* b )
+		{
+			b->owners.fetch_add( 1, std::memory_order_relaxed );
+			return b;
+		}
+
+		static void _release( buffer* b )
+		{
+			if( b->owners.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+				delete b;
+			}
+		}
+
+		// For operations that discard the old content: a shared buffer is
+		// released instead of being cloned first.
+		Vector& _replace()
+		{
+			if( is_shared() ) {
+				buffer* old = data_;
+				data_ = new buffer( Vector() );
+				_release( old );
+			} else {
+				data_->vec.clear();
+			}
+			return data_->vec;
+		}
+
+		buffer* data_;
+	};
+
+}
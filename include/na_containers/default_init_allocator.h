@@ -0,0 +1,65 @@
+#pragma once
+#include <na_containers/aligned_allocator.h>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace na {
+
+	// Allocator adaptor whose construct( p ) default-initializes instead of
+	// value-initializing, so resizing a vector of trivial elements only
+	// allocates. The pages of a large buffer are then touched first by
+	// whoever fills it, which is what the parallel_t constructors of
+	// na_vector and array2d rely on; with std::allocator they still work,
+	// but the zeroing pass already placed every page.
+	template< typename T, typename Base = std::allocator< T > >
+	class default_init_allocator : public Base {
+	public:
+		typedef typename Base::value_type value_type;
+		typedef typename Base::pointer pointer;
+		typedef typename Base::const_pointer const_pointer;
+		typedef typename Base::reference reference;
+		typedef typename Base::const_reference const_reference;
+		typedef typename Base::size_type size_type;
+		typedef typename Base::difference_type difference_type;
+
+		template< typename U >
+		struct rebind {
+			typedef default_init_allocator< U, typename Base::template rebind< U >::other > other;
+		};
+
+	public:
+		default_init_allocator()
+		{
+		}
+
+		default_init_allocator( const Base& base )
+			: Base( base )
+		{
+		}
+
+		template< typename U, typename OtherBase >
+		default_init_allocator( const default_init_allocator< U, OtherBase >& other )
+			: Base( static_cast< const OtherBase& >( other ) )
+		{
+		}
+
+		template< typename U >
+		void construct( U* p )
+		{
+			::new( static_cast< void* >( p ) ) U;
+		}
+
+		template< typename U, typename V >
+		void construct( U* p, V&& val )
+		{
+			::new( static_cast< void* >( p ) ) U( std::forward< V >( val ) );
+		}
+	};
+
+	template< typename T, typename Base >
+	struct allocator_alignment< default_init_allocator< T, Base > > {
+		static const std::size_t value = allocator_alignment< Base >::value;
+	};
+
+}
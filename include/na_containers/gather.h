@@ -0,0 +1,113 @@
+#pragma once
+#include <na_containers/platform.h>
+#include <cstddef>
+#include <vector>
+
+namespace na {
+
+	namespace detail {
+
+		// Index meaning "no element": out of range for every container.
+		const std::size_t invalid_index = std::size_t(-1);
+
+		// Distance, in elements, at which gather/scatter prefetch ahead.
+		const std::size_t prefetch_distance = 16;
+
+		template< typename ValueType > struct na_value_traits;
+
+		// Turns an index vector into plain positions below count. NA, negative
+		// and out-of-range entries become invalid_index. The range is checked
+		// before converting, since converting a negative or too large floating
+		// point value to std::size_t is undefined.
+		template< typename IndexVector >
+		std::vector< std::size_t > resolve_indices( const IndexVector& indices, std::size_t count )
+		{
+			typedef typename IndexVector::policy_type policy;
+			typedef na_value_traits< typename IndexVector::value_type > traits;
+			typedef typename traits::raw_type raw_type;
+
+			std::vector< std::size_t > result( indices.size(), invalid_index );
+			for( std::size_t k = 0; k < indices.size(); ++k ) {
+				if( policy::is_na( indices[k] ) ) {
+					continue;
+				}
+				const raw_type value = traits::get( indices[k] );
+				if( !(value < raw_type(0)) && double( value ) < double( count ) ) {
+					result[k] = static_cast< std::size_t >( value );
+				}
+			}
+			return result;
+		}
+
+		// out[k] = base[ index[k] ], or na for invalid positions.
+		template< typename ValueType >
+		void gather( ValueType* out, const ValueType* base, std::size_t size,
+					 const std::size_t* index, std::size_t count, const ValueType& na )
+		{
+			for( std::size_t k = 0; k < count; ++k ) {
+				if( k + prefetch_distance < count && index[ k + prefetch_distance ] < size ) {
+					NA_PREFETCH( base + index[ k + prefetch_distance ] );
+				}
+				out[k] = index[k] < size ? base[ index[k] ] : na;
+			}
+		}
+
+#if defined(NA_HAVE_AVX2) && (defined(_WIN64) || defined(__x86_64__))
+		// Hardware gathers; invalid lanes are masked off and keep na.
+		inline void gather( double* out, const double* base, std::size_t size,
+							const std::size_t* index, std::size_t count, const double& na )
+		{
+			const __m256i limit = _mm256_set1_epi64x( static_cast< long long >( size ) );
+			const __m256i zero  = _mm256_setzero_si256();
+			const __m256d fill  = _mm256_set1_pd( na );
+
+			std::size_t k = 0;
+			for( ; k + 4 <= count; k += 4 ) {
+				const __m256i idx  = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( index + k ) );
+				const __m256i mask = _mm256_andnot_si256( _mm256_cmpgt_epi64( zero, idx ), _mm256_cmpgt_epi64( limit, idx ) );
+				_mm256_storeu_pd( out + k, _mm256_mask_i64gather_pd( fill, base, idx, _mm256_castsi256_pd( mask ), 8 ) );
+			}
+			for( ; k < count; ++k ) {
+				out[k] = index[k] < size ? base[ index[k] ] : na;
+			}
+		}
+
+		inline void gather( float* out, const float* base, std::size_t size,
+							const std::size_t* index, std::size_t count, const float& na )
+		{
+			const __m256i limit = _mm256_set1_epi64x( static_cast< long long >( size ) );
+			const __m256i zero  = _mm256_setzero_si256();
+			const __m128  fill  = _mm_set1_ps( na );
+
+			std::size_t k = 0;
+			for( ; k + 4 <= count; k += 4 ) {
+				const __m256i idx  = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( index + k ) );
+				const __m256i mask = _mm256_andnot_si256( _mm256_cmpgt_epi64( zero, idx ), _mm256_cmpgt_epi64( limit, idx ) );
+				// narrow the 64 bit lane mask to 32 bit lanes
+				const __m256i packed = _mm256_permutevar8x32_epi32( mask, _mm256_setr_epi32( 0, 2, 4, 6, 1, 3, 5, 7 ) );
+				_mm_storeu_ps( out + k, _mm256_mask_i64gather_ps( fill, base, idx, _mm_castsi128_ps( _mm256_castsi256_si128( packed ) ), 4 ) );
+			}
+			for( ; k < count; ++k ) {
+				out[k] = index[k] < size ? base[ index[k] ] : na;
+			}
+		}
+#endif
+
+		// base[ index[k] ] = values[k] for every valid position.
+		template< typename ValueType, typename Source >
+		void scatter( ValueType* base, std::size_t size,
+					  const std::size_t* index, std::size_t count, const Source& values )
+		{
+			for( std::size_t k = 0; k < count; ++k ) {
+				if( k + prefetch_distance < count && index[ k + prefetch_distance ] < size ) {
+					NA_PREFETCH( base + index[ k + prefetch_distance ] );
+				}
+				if( index[k] < size ) {
+					base[ index[k] ] = values[k];
+				}
+			}
+		}
+
+	}
+
+}
@@ -0,0 +1,582 @@
+#pragma once
+#include <boost/cstdint.hpp>
+#include <boost/logic/tribool.hpp>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Included at the end of na_vector.h, so the specialization is visible
+// wherever na_vector is.
+
+namespace na {
+
+	namespace policies {
+
+		// Element policy of na_vector<bool>: an element reads as a tribool
+		// whose indeterminate state is NA.
+		class NaPolicyTribool {
+		public:
+			typedef boost::logic::tribool value_type;
+
+		public:
+			static bool is_na( const value_type& val )
+			{
+				return boost::logic::indeterminate( val );
+			}
+
+			static const value_type get_na()
+			{
+				return value_type( boost::logic::indeterminate );
+			}
+		};
+
+	}
+
+	namespace detail {
+
+		typedef boost::uint64_t bit_word;
+		const std::size_t bit_word_bits = 64;
+
+		// Words needed for n bits.
+		inline std::size_t bit_word_count( std::size_t n )
+		{
+			return (n + bit_word_bits - 1) / bit_word_bits;
+		}
+
+		inline std::size_t popcount( bit_word word )
+		{
+#if defined(_MSC_VER) && defined(_WIN64)
+			return std::size_t( __popcnt64( word ) );
+#elif defined(_MSC_VER)
+			return std::size_t( __popcnt( unsigned( word ) ) + __popcnt( unsigned( word >> 32 ) ) );
+#else
+			return std::size_t( __builtin_popcountll( word ) );
+#endif
+		}
+
+		// Index of the lowest set bit; word must not be 0.
+		inline std::size_t lowest_bit( bit_word word )
+		{
+#if defined(_MSC_VER) && defined(_WIN64)
+			unsigned long index;
+			_BitScanForward64( &index, word );
+			return index;
+#elif defined(_MSC_VER)
+			unsigned long index;
+			if( _BitScanForward( &index, unsigned( word ) ) ) {
+				return index;
+			}
+			_BitScanForward( &index, unsigned( word >> 32 ) );
+			return index + 32;
+#else
+			return std::size_t( __builtin_ctzll( word ) );
+#endif
+		}
+
+		// Index of the highest set bit; word must not be 0.
+		inline std::size_t highest_bit( bit_word word )
+		{
+#if defined(_MSC_VER) && defined(_WIN64)
+			unsigned long index;
+			_BitScanReverse64( &index, word );
+			return index;
+#elif defined(_MSC_VER)
+			unsigned long index;
+			if( _BitScanReverse( &index, unsigned( word >> 32 ) ) ) {
+				return index + 32;
+			}
+			_BitScanReverse( &index, unsigned( word ) );
+			return index;
+#else
+			return std::size_t( 63 - __builtin_clzll( word ) );
+#endif
+		}
+
+	}
+
+	// Tri-state boolean vector packed into two bitplanes: values_ holds a 1
+	// for every true element, na_ a 1 for every NA element. An NA element
+	// always has a 0 value bit, and bits past size() are 0 in both planes, so
+	// the logical operators and the counts work on whole words.
+	//
+	// Like std::vector<bool> it hands out proxies instead of references and
+	// has no data(); elements read as boost::logic::tribool. As a selection
+	// mask (select(), array2d::select_rows, table::select_rows) true selects,
+	// false and NA drop.
+	template< class NaPolicy, typename Allocator >
+	class na_vector< bool, NaPolicy, Allocator > {
+	public:
+		typedef policies::NaPolicyTribool policy_type;
+		typedef policy_type::value_type value_type;
+		typedef detail::bit_word word_type;
+		typedef typename Allocator::template rebind< word_type >::other allocator_type;
+		typedef std::vector< word_type, allocator_type > container_type;
+		typedef std::size_t size_type;
+		typedef std::ptrdiff_t difference_type;
+
+		typedef value_type const_reference;
+
+		class reference {
+		public:
+			reference( na_vector& vec, size_type index )
+				: vec_( vec ), index_( index )
+			{
+			}
+
+			operator value_type() const
+			{
+				return vec_.get( index_ );
+			}
+
+			reference& operator=( bool val )
+			{
+				vec_.set( index_, val );
+				return *this;
+			}
+
+			reference& operator=( const detail::_na_type& )
+			{
+				vec_.set( index_, NA );
+				return *this;
+			}
+
+			reference& operator=( const value_type& val )
+			{
+				vec_.set( index_, val );
+				return *this;
+			}
+
+			reference& operator=( const reference& other )
+			{
+				vec_.set( index_, value_type( other ) );
+				return *this;
+			}
+
+		private:
+			na_vector& vec_;
+			size_type index_;
+		};
+
+	public:
+		static value_type get_na() {
+			return policy_type::get_na();
+		}
+
+	public:
+		na_vector()
+			: size_( 0 )
+		{
+		}
+
+		// n false elements.
+		explicit na_vector( size_type n )
+			: values_( word_count( n ), 0 ), na_( word_count( n ), 0 ), size_( n )
+		{
+		}
+
+		na_vector( size_type n, bool val )
+			: values_( word_count( n ), val ? ~word_type(0) : 0 ), na_( word_count( n ), 0 ), size_( n )
+		{
+			_clear_tail();
+		}
+
+		na_vector( size_type n, const detail::_na_type& )
+			: values_( word_count( n ), 0 ), na_( word_count( n ), ~word_type(0) ), size_( n )
+		{
+			_clear_tail();
+		}
+
+		na_vector( const na_vector& x )
+			: values_( x.values_ ), na_( x.na_ ), size_( x.size_ )
+		{
+		}
+
+		na_vector( na_vector&& x )
+			: values_( std::move( x.values_ ) ), na_( std::move( x.na_ ) ), size_( x.size_ )
+		{
+			x.size_ = 0;
+		}
+
+		na_vector& operator=( const na_vector& x )
+		{
+			values_ = x.values_;
+			na_ = x.na_;
+			size_ = x.size_;
+			return *this;
+		}
+
+		na_vector& operator=( na_vector&& x )
+		{
+			swap( x );
+			return *this;
+		}
+
+		// element access
+	public:
+		value_type get( size_type index ) const
+		{
+			if( _bit( na_, index ) ) {
+				return get_na();
+			}
+			return value_type( _bit( values_, index ) );
+		}
+
+		bool is_na( size_type index ) const
+		{
+			return _bit( na_, index );
+		}
+
+		// True and not NA.
+		bool is_true( size_type index ) const
+		{
+			return _bit( values_, index );
+		}
+
+		void set( size_type index, bool val )
+		{
+			_assign( na_, index, false );
+			_assign( values_, index, val );
+		}
+
+		void set( size_type index, const detail::_na_type& )
+		{
+			_assign( na_, index, true );
+			_assign( values_, index, false );
+		}
+
+		void set( size_type index, const value_type& val )
+		{
+			if( policy_type::is_na( val ) ) {
+				set( index, NA );
+			} else {
+				set( index, bool( val ) );
+			}
+		}
+
+		const_reference operator[]( size_type index ) const
+		{
+			return get( index );
+		}
+
+		reference operator[]( size_type index )
+		{
+			return reference( *this, index );
+		}
+
+		const_reference front() const
+		{
+			return get( 0 );
+		}
+
+		const_reference back() const
+		{
+			return get( size_ - 1 );
+		}
+
+		void push_back( bool val )
+		{
+			resize( size_ + 1 );
+			set( size_ - 1, val );
+		}
+
+		void push_back( const detail::_na_type& )
+		{
+			resize( size_ + 1 );
+			set( size_ - 1, NA );
+		}
+
+		void push_back( const value_type& val )
+		{
+			resize( size_ + 1 );
+			set( size_ - 1, val );
+		}
+
+		void pop_back()
+		{
+			resize( size_ - 1 );
+		}
+
+		// capacity
+	public:
+		size_type size() const
+		{
+			return size_;
+		}
+
+		bool empty() const
+		{
+			return size_ == 0;
+		}
+
+		size_type capacity() const
+		{
+			return values_.capacity() * detail::bit_word_bits;
+		}
+
+		void reserve( size_type n )
+		{
+			values_.reserve( word_count( n ) );
+			na_.reserve( word_count( n ) );
+		}
+
+		// New elements are false.
+		void resize( size_type n )
+		{
+			values_.resize( word_count( n ), 0 );
+			na_.resize( word_count( n ), 0 );
+			size_ = n;
+			_clear_tail();
+		}
+
+		void resize( size_type n, bool val )
+		{
+			const size_type old_size = size_;
+			resize( n );
+			for( size_type i = old_size; i < n; ++i ) {
+				set( i, val );
+			}
+		}
+
+		void resize( size_type n, const detail::_na_type& )
+		{
+			const size_type old_size = size_;
+			resize( n );
+			for( size_type i = old_size; i < n; ++i ) {
+				set( i, NA );
+			}
+		}
+
+		void clear()
+		{
+			values_.clear();
+			na_.clear();
+			size_ = 0;
+		}
+
+		void swap( na_vector& x )
+		{
+			values_.swap( x.values_ );
+			na_.swap( x.na_ );
+			std::swap( size_, x.size_ );
+		}
+
+		// bitplanes
+	public:
+		static size_type word_count( size_type n )
+		{
+			return detail::bit_word_count( n );
+		}
+
+		size_type word_count() const
+		{
+			return values_.size();
+		}
+
+		const word_type* value_words() const
+		{
+			return values_.data();
+		}
+
+		const word_type* na_words() const
+		{
+			return na_.data();
+		}
+
+		// counts
+	public:
+		size_type count_true() const
+		{
+			size_type result = 0;
+			for( size_type w = 0; w < values_.size(); ++w ) {
+				result += detail::popcount( values_[w] );
+			}
+			return result;
+		}
+
+		size_type count_na() const
+		{
+			size_type result = 0;
+			for( size_type w = 0; w < na_.size(); ++w ) {
+				result += detail::popcount( na_[w] );
+			}
+			return result;
+		}
+
+		size_type count_false() const
+		{
+			return size_ - count_true() - count_na();
+		}
+
+		// Positions of the true elements, in order.
+		std::vector< size_type > true_positions() const
+		{
+			std::vector< size_type > result;
+			result.reserve( count_true() );
+			for( size_type w = 0; w < values_.size(); ++w ) {
+				for( word_type word = values_[w]; word; word &= word - 1 ) {
+					result.push_back( w * detail::bit_word_bits + detail::lowest_bit( word ) );
+				}
+			}
+			return result;
+		}
+
+		// Kleene logic, whole words at a time
+	public:
+		// false & x == false, true & NA == NA
+		na_vector& operator&=( const na_vector& x )
+		{
+			_check_length( x );
+			for( size_type w = 0; w < values_.size(); ++w ) {
+				const word_type known_false = (~values_[w] & ~na_[w]) | (~x.values_[w] & ~x.na_[w]);
+				values_[w] &= x.values_[w];
+				na_[w] = ~(values_[w] | known_false);
+			}
+			_clear_tail();
+			return *this;
+		}
+
+		// true | x == true, false | NA == NA
+		na_vector& operator|=( const na_vector& x )
+		{
+			_check_length( x );
+			for( size_type w = 0; w < values_.size(); ++w ) {
+				const word_type known_false = ~values_[w] & ~na_[w] & ~x.values_[w] & ~x.na_[w];
+				values_[w] |= x.values_[w];
+				na_[w] = ~(values_[w] | known_false);
+			}
+			_clear_tail();
+			return *this;
+		}
+
+		// !NA == NA
+		void flip()
+		{
+			for( size_type w = 0; w < values_.size(); ++w ) {
+				values_[w] = ~values_[w] & ~na_[w];
+			}
+			_clear_tail();
+		}
+
+	private:
+		void _check_length( const na_vector& x ) const
+		{
+			if( size_ != x.size_ ) {
+				throw std::invalid_argument( "na::na_mask: operands differ in length" );
+			}
+		}
+
+		static bool _bit( const container_type& plane, size_type index )
+		{
+			return (plane[index / detail::bit_word_bits] >> (index % detail::bit_word_bits)) & 1;
+		}
+
+		static void _assign( container_type& plane, size_type index, bool val )
+		{
+			const word_type bit = word_type(1) << (index % detail::bit_word_bits);
+			word_type& word = plane[index / detail::bit_word_bits];
+			word = val ? (word | bit) : (word & ~bit);
+		}
+
+		void _clear_tail()
+		{
+			const size_type used = size_ % detail::bit_word_bits;
+			if( used ) {
+				const word_type mask = (word_type(1) << used) - 1;
+				values_.back() &= mask;
+				na_.back() &= mask;
+			}
+		}
+
+		container_type values_;
+		container_type na_;
+		size_type size_;
+	};
+
+	template< class NaPolicy, typename Allocator >
+	na_vector< bool, NaPolicy, Allocator > operator&( na_vector< bool, NaPolicy, Allocator > a, const na_vector< bool, NaPolicy, Allocator >& b )
+	{
+		a &= b;
+		return a;
+	}
+
+	template< class NaPolicy, typename Allocator >
+	na_vector< bool, NaPolicy, Allocator > operator|( na_vector< bool, NaPolicy, Allocator > a, const na_vector< bool, NaPolicy, Allocator >& b )
+	{
+		a |= b;
+		return a;
+	}
+
+	template< class NaPolicy, typename Allocator >
+	na_vector< bool, NaPolicy, Allocator > operator!( na_vector< bool, NaPolicy, Allocator > a )
+	{
+		a.flip();
+		return a;
+	}
+
+	typedef na_vector< bool > na_mask;
+
+	// Mask holding pred( value ) for every non-NA element of values and NA
+	// for every NA element.
+	template< typename Vector, typename Predicate >
+	na_mask make_mask( const Vector& values, Predicate pred )
+	{
+		typedef typename Vector::policy_type policy;
+		na_mask result( values.size() );
+		for( std::size_t i = 0; i < values.size(); ++i ) {
+			if( policy::is_na( values[i] ) ) {
+				result.set( i, NA );
+			} else if( pred( values[i] ) ) {
+				result.set( i, true );
+			}
+		}
+		return result;
+	}
+
+	namespace detail {
+
+		inline void check_mask_size( std::size_t mask_size, std::size_t count )
+		{
+			if( mask_size != count ) {
+				throw std::invalid_argument( "na::select: mask length does not match" );
+			}
+		}
+
+		// Positions selected by a mask with count entries: any type with size()
+		// and a bool-convertible operator[] ...
+		template< typename Mask >
+		std::vector< std::size_t > mask_positions( const Mask& mask, std::size_t count )
+		{
+			check_mask_size( mask.size(), count );
+			std::vector< std::size_t > positions;
+			for( std::size_t i = 0; i < count; ++i ) {
+				if( mask[i] ) {
+					positions.push_back( i );
+				}
+			}
+			return positions;
+		}
+
+		// ... or a packed mask, scanned a word at a time.
+		template< class NaPolicy, typename Allocator >
+		std::vector< std::size_t > mask_positions( const na_vector< bool, NaPolicy, Allocator >& mask, std::size_t count )
+		{
+			check_mask_size( mask.size(), count );
+			return mask.true_positions();
+		}
+
+	}
+
+	// The elements of values at the true positions of mask, in order.
+	template< typename Vector, typename Mask >
+	Vector select( const Vector& values, const Mask& mask )
+	{
+		const std::vector< std::size_t > positions = detail::mask_positions( mask, values.size() );
+		Vector result( positions.size() );
+		detail::gather( result.data(), values.data(), values.size(), positions.data(), positions.size(), Vector::get_na() );
+		return result;
+	}
+
+}
@@ -0,0 +1,321 @@
+#pragma once
+#include <na_containers/na_vector.h>
+#include <na_containers/array2d.h>
+#include <na_containers/array2d_stats.h>
+#include <na_containers/na_zip.h>
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// Elementwise operations between an array2d and an na_vector broadcast over
+// its rows or columns, in place and in one pass over the storage.
+//
+//   m -= na::as_row( means );     // means has cols() entries, one per column
+//   m /= na::as_col( scale );     // scale has rows() entries, one per row
+//   na::add_outer( m, a, b );     // m( r, c ) += a[r] * b[c]
+//   na::center_columns( m );      // subtract the column means
+//   na::standardize_columns( m ); // and divide by the standard deviations
+//
+// The array is walked in storage order. A vector that runs along the major
+// slices is read alongside each slice, so the inner loop reads two
+// contiguous ranges; a vector across them contributes one value per slice.
+// As in na_zip.h the NA flags are combined first and the operation runs on
+// plain values, so the result is NA wherever the element or the broadcast
+// operand is, and the inner loops do not branch.
+
+namespace na {
+
+	// A vector with one entry per column, repeated for every row.
+	template< typename Vector >
+	struct row_broadcast {
+		explicit row_broadcast( const Vector& v ) : vec( v ) {}
+		const Vector& vec;
+	};
+
+	// A vector with one entry per row, repeated for every column.
+	template< typename Vector >
+	struct col_broadcast {
+		explicit col_broadcast( const Vector& v ) : vec( v ) {}
+		const Vector& vec;
+	};
+
+	template< typename Vector >
+	row_broadcast< Vector > as_row( const Vector& vec )
+	{
+		return row_broadcast< Vector >( vec );
+	}
+
+	template< typename Vector >
+	col_broadcast< Vector > as_col( const Vector& vec )
+	{
+		return col_broadcast< Vector >( vec );
+	}
+
+	namespace detail {
+
+		inline void check_broadcast_length( std::size_t vector_size, std::size_t extent )
+		{
+			if( vector_size != extent ) {
+				throw std::invalid_argument( "na::broadcast: vector length does not match the array" );
+			}
+		}
+
+		template< typename Array, typename Vector >
+		struct broadcast_operands {
+			typedef typename array_policy< Array >::type array_policy_type;
+			typedef typename Vector::policy_type vector_policy_type;
+			typedef na_value_traits< typename Array::value_type > traits;
+			typedef na_value_traits< typename Vector::value_type > vector_traits;
+			typedef typename traits::raw_type raw_type;
+			typedef typename vector_traits::raw_type vector_raw_type;
+
+			// NA operands read as 1, as in zip_transform
+			static raw_type get( const typename Array::value_type& val, bool is_na )
+			{
+				return is_na ? raw_type(1) : traits::get( val );
+			}
+
+			static vector_raw_type get_vector( const typename Vector::value_type& val, bool is_na )
+			{
+				return is_na ? vector_raw_type(1) : vector_traits::get( val );
+			}
+		};
+
+		// The vector runs across the major slices: slice i uses vec[i].
+		template< typename Array, typename Vector, typename Op >
+		void broadcast_slices( Array& arr, const Vector& vec, Op op, tags::major_tag )
+		{
+			typedef broadcast_operands< Array, Vector > operands;
+			const typename Array::value_type na = operands::array_policy_type::get_na();
+
+			for( std::size_t i = 0; i < arr.minor_size(); ++i ) {
+				typename Array::value_type* slice = arr.data() + i * arr.stride();
+				const bool scalar_na = operands::vector_policy_type::is_na( vec[i] );
+				const typename operands::vector_raw_type scalar = operands::get_vector( vec[i], scalar_na );
+
+				for( std::size_t j = 0; j < arr.major_size(); ++j ) {
+					const bool is_na = scalar_na | operands::array_policy_type::is_na( slice[j] );
+					const typename operands::raw_type result = typename operands::raw_type( op( operands::get( slice[j], is_na ), scalar ) );
+					slice[j] = is_na ? na : operands::traits::make( result );
+				}
+			}
+		}
+
+		// The vector runs along the major slices: element j of every slice
+		// uses vec[j].
+		template< typename Array, typename Vector, typename Op >
+		void broadcast_slices( Array& arr, const Vector& vec, Op op, tags::minor_tag )
+		{
+			typedef broadcast_operands< Array, Vector > operands;
+			const typename Array::value_type na = operands::array_policy_type::get_na();
+			const typename Vector::value_type* lanes = vec.data();
+
+			for( std::size_t i = 0; i < arr.minor_size(); ++i ) {
+				typename Array::value_type* slice = arr.data() + i * arr.stride();
+				for( std::size_t j = 0; j < arr.major_size(); ++j ) {
+					const bool is_na = operands::vector_policy_type::is_na( lanes[j] ) | operands::array_policy_type::is_na( slice[j] );
+					const typename operands::raw_type result = typename operands::raw_type( op( operands::get( slice[j], is_na ), operands::get_vector( lanes[j], is_na ) ) );
+					slice[j] = is_na ? na : operands::traits::make( result );
+				}
+			}
+		}
+
+		// arr( r, c ) += lane[j] * across[i] with j the position in major
+		// slice i.
+		template< typename Array, typename LaneVector, typename SliceVector >
+		void outer_update( Array& arr, const LaneVector& lane, const SliceVector& across )
+		{
+			typedef broadcast_operands< Array, LaneVector > lane_operands;
+			typedef broadcast_operands< Array, SliceVector > slice_operands;
+			typedef typename lane_operands::raw_type raw_type;
+			const typename Array::value_type na = lane_operands::array_policy_type::get_na();
+			const typename LaneVector::value_type* lanes = lane.data();
+
+			for( std::size_t i = 0; i < arr.minor_size(); ++i ) {
+				typename Array::value_type* slice = arr.data() + i * arr.stride();
+				const bool scalar_na = slice_operands::vector_policy_type::is_na( across[i] );
+				const raw_type scalar = raw_type( slice_operands::get_vector( across[i], scalar_na ) );
+
+				for( std::size_t j = 0; j < arr.major_size(); ++j ) {
+					const bool is_na = scalar_na | lane_operands::vector_policy_type::is_na( lanes[j] ) | lane_operands::array_policy_type::is_na( slice[j] );
+					const raw_type result = raw_type( lane_operands::get( slice[j], is_na ) + raw_type( lane_operands::get_vector( lanes[j], is_na ) ) * scalar );
+					slice[j] = is_na ? na : lane_operands::traits::make( result );
+				}
+			}
+		}
+
+		// x = (x - shift[k]) * scale[k] for slices k of the kind given by the
+		// tag, one pass; NA stays NA.
+		template< typename Array >
+		void affine_slices( Array& arr, const std::vector< double >& shift, const std::vector< double >& scale, tags::major_tag )
+		{
+			typedef typename array_policy< Array >::type policy;
+			typedef na_value_traits< typename Array::value_type > traits;
+			typedef typename traits::raw_type raw_type;
+			const typename Array::value_type na = policy::get_na();
+
+			for( std::size_t i = 0; i < arr.minor_size(); ++i ) {
+				typename Array::value_type* slice = arr.data() + i * arr.stride();
+				const double s = shift[i], f = scale[i];
+				for( std::size_t j = 0; j < arr.major_size(); ++j ) {
+					const bool is_na = policy::is_na( slice[j] );
+					const double x = is_na ? 0.0 : double( traits::get( slice[j] ) );
+					slice[j] = is_na ? na : traits::make( raw_type( (x - s) * f ) );
+				}
+			}
+		}
+
+		template< typename Array >
+		void affine_slices( Array& arr, const std::vector< double >& shift, const std::vector< double >& scale, tags::minor_tag )
+		{
+			typedef typename array_policy< Array >::type policy;
+			typedef na_value_traits< typename Array::value_type > traits;
+			typedef typename traits::raw_type raw_type;
+			const typename Array::value_type na = policy::get_na();
+
+			for( std::size_t i = 0; i < arr.minor_size(); ++i ) {
+				typename Array::value_type* slice = arr.data() + i * arr.stride();
+				for( std::size_t j = 0; j < arr.major_size(); ++j ) {
+					const bool is_na = policy::is_na( slice[j] );
+					const double x = is_na ? 0.0 : double( traits::get( slice[j] ) );
+					slice[j] = is_na ? na : traits::make( raw_type( (x - shift[j]) * scale[j] ) );
+				}
+			}
+		}
+
+		// Shift and scale per slice from slice_stats. Slices without values
+		// keep shift 0; a scale is only applied where the standard deviation
+		// is positive, so constant slices are just centered.
+		template< typename Stats >
+		void affine_from_stats( const std::vector< Stats >& stats, bool standardize, std::vector< double >& shift, std::vector< double >& scale )
+		{
+			shift.assign( stats.size(), 0.0 );
+			scale.assign( stats.size(), 1.0 );
+			for( std::size_t k = 0; k < stats.size(); ++k ) {
+				if( stats[k].count > 0 ) {
+					shift[k] = stats[k].mean;
+				}
+				if( standardize && stats[k].count > 1 && stats[k].variance > 0.0 ) {
+					scale[k] = 1.0 / std::sqrt( stats[k].variance );
+				}
+			}
+		}
+
+	}
+
+	// array2d op= as_row( v ) / as_col( v ), for op in + - * /.
+	template< typename ContainerType, typename OrderType, typename Vector >
+	array2d< ContainerType, OrderType >& operator+=( array2d< ContainerType, OrderType >& arr, const row_broadcast< Vector >& row )
+	{
+		detail::check_broadcast_length( row.vec.size(), arr.cols() );
+		detail::broadcast_slices( arr, row.vec, ops::add(), typename array2d< ContainerType, OrderType >::column_tag() );
+		return arr;
+	}
+
+	template< typename ContainerType, typename OrderType, typename Vector >
+	array2d< ContainerType, OrderType >& operator-=( array2d< ContainerType, OrderType >& arr, const row_broadcast< Vector >& row )
+	{
+		detail::check_broadcast_length( row.vec.size(), arr.cols() );
+		detail::broadcast_slices( arr, row.vec, ops::subtract(), typename array2d< ContainerType, OrderType >::column_tag() );
+		return arr;
+	}
+
+	template< typename ContainerType, typename OrderType, typename Vector >
+	array2d< ContainerType, OrderType >& operator*=( array2d< ContainerType, OrderType >& arr, const row_broadcast< Vector >& row )
+	{
+		detail::check_broadcast_length( row.vec.size(), arr.cols() );
+		detail::broadcast_slices( arr, row.vec, ops::multiply(), typename array2d< ContainerType, OrderType >::column_tag() );
+		return arr;
+	}
+
+	template< typename ContainerType, typename OrderType, typename Vector >
+	array2d< ContainerType, OrderType >& operator/=( array2d< ContainerType, OrderType >& arr, const row_broadcast< Vector >& row )
+	{
+		detail::check_broadcast_length( row.vec.size(), arr.cols() );
+		detail::broadcast_slices( arr, row.vec, ops::divide(), typename array2d< ContainerType, OrderType >::column_tag() );
+		return arr;
+	}
+
+	template< typename ContainerType, typename OrderType, typename Vector >
+	array2d< ContainerType, OrderType >& operator+=( array2d< ContainerType, OrderType >& arr, const col_broadcast< Vector >& col )
+	{
+		detail::check_broadcast_length( col.vec.size(), arr.rows() );
+		detail::broadcast_slices( arr, col.vec, ops::add(), typename array2d< ContainerType, OrderType >::row_tag() );
+		return arr;
+	}
+
+	template< typename ContainerType, typename OrderType, typename Vector >
+	array2d< ContainerType, OrderType >& operator-=( array2d< ContainerType, OrderType >& arr, const col_broadcast< Vector >& col )
+	{
+		detail::check_broadcast_length( col.vec.size(), arr.rows() );
+		detail::broadcast_slices( arr, col.vec, ops::subtract(), typename array2d< ContainerType, OrderType >::row_tag() );
+		return arr;
+	}
+
+	template< typename ContainerType, typename OrderType, typename Vector >
+	array2d< ContainerType, OrderType >& operator*=( array2d< ContainerType, OrderType >& arr, const col_broadcast< Vector >& col )
+	{
+		detail::check_broadcast_length( col.vec.size(), arr.rows() );
+		detail::broadcast_slices( arr, col.vec, ops::multiply(), typename array2d< ContainerType, OrderType >::row_tag() );
+		return arr;
+	}
+
+	template< typename ContainerType, typename OrderType, typename Vector >
+	array2d< ContainerType, OrderType >& operator/=( array2d< ContainerType, OrderType >& arr, const col_broadcast< Vector >& col )
+	{
+		detail::check_broadcast_length( col.vec.size(), arr.rows() );
+		detail::broadcast_slices( arr, col.vec, ops::divide(), typename array2d< ContainerType, OrderType >::row_tag() );
+		return arr;
+	}
+
+	// arr( r, c ) += a[r] * b[c]; a has rows() entries, b cols().
+	template< typename Array, typename VectorA, typename VectorB >
+	void add_outer( Array& arr, const VectorA& a, const VectorB& b )
+	{
+		detail::check_broadcast_length( a.size(), arr.rows() );
+		detail::check_broadcast_length( b.size(), arr.cols() );
+		if( std::is_same< typename Array::row_tag, tags::minor_tag >::value ) {
+			detail::outer_update( arr, a, b );		// rows are positions within the major slices
+		} else {
+			detail::outer_update( arr, b, a );
+		}
+	}
+
+	// Subtracts the mean of every column (row) from its non-NA elements.
+	// Meant for floating point arrays.
+	template< typename Array >
+	void center_columns( Array& arr )
+	{
+		std::vector< double > shift, scale;
+		detail::affine_from_stats( column_stats( arr ), false, shift, scale );
+		detail::affine_slices( arr, shift, scale, typename Array::column_tag() );
+	}
+
+	template< typename Array >
+	void center_rows( Array& arr )
+	{
+		std::vector< double > shift, scale;
+		detail::affine_from_stats( row_stats( arr ), false, shift, scale );
+		detail::affine_slices( arr, shift, scale, typename Array::row_tag() );
+	}
+
+	// Centers every column (row) and divides it by its sample standard
+	// deviation; two passes, one for the statistics and one to apply them.
+	template< typename Array >
+	void standardize_columns( Array& arr )
+	{
+		std::vector< double > shift, scale;
+		detail::affine_from_stats( column_stats( arr ), true, shift, scale );
+		detail::affine_slices( arr, shift, scale, typename Array::column_tag() );
+	}
+
+	template< typename Array >
+	void standardize_rows( Array& arr )
+	{
+		std::vector< double > shift, scale;
+		detail::affine_from_stats( row_stats( arr ), true, shift, scale );
+		detail::affine_slices( arr, shift, scale, typename Array::row_tag() );
+	}
+
+}
@@ -0,0 +1,235 @@
+#pragma once
+#include <na_containers/array2d.h>
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace na {
+
+	// array2d shared between many readers and one writer, with epoch based
+	// reclamation instead of a lock on the read path.
+	//
+	// The current version is an immutable Array behind an atomic pointer.
+	// read() claims one of ReaderSlots slots, stamps it with the global epoch
+	// and loads the pointer; the returned snapshot keeps that version alive
+	// until it is destroyed. That is one compare-exchange and one store per
+	// snapshot, no matter how many elements are read through it.
+	//
+	// The writer never touches a published version: resize, reserve, reshape
+	// and update build the next version from a copy, swap the pointer,
+	// advance the epoch and retire the old version tagged with the new epoch.
+	// A retired version is deleted once no slot holds an older epoch, i.e.
+	// once every reader that could have loaded it has let go. Readers keep
+	// running at full speed while the matrix grows; a reader that holds a
+	// snapshot for long only delays reclamation.
+	//
+	// Writers are serialized by a mutex. When all slots are taken, read()
+	// yields until one is free. Destruction must not race with anything.
+	template< typename Array, std::size_t ReaderSlots = 64 >
+	class concurrent_array2d {
+		struct reader_slot {
+			std::atomic< boost::uint64_t > epoch;	// 0: free
+			char pad[ 64 - sizeof( std::atomic< boost::uint64_t > ) ];
+		};
+
+	public:
+		typedef Array array_type;
+		typedef typename Array::size_type size_type;
+
+		// Read access to one version. Movable, not copyable.
+		class snapshot {
+		public:
+			snapshot( snapshot&& other )
+				: slot_( other.slot_ ), array_( other.array_ )
+			{
+				other.slot_ = nullptr;
+			}
+
+			~snapshot()
+			{
+				if( slot_ ) {
+					slot_->store( 0, std::memory_order_release );
+				}
+			}
+
+			const Array& operator*() const
+			{
+				return *array_;
+			}
+
+			const Array* operator->() const
+			{
+				return array_;
+			}
+
+			const Array& get() const
+			{
+				return *array_;
+			}
+
+		private:
+			friend class concurrent_array2d;
+
+			snapshot( std::atomic< boost::uint64_t >* slot, const Array* array )
+				: slot_( slot ), array_( array )
+			{
+			}
+
+			snapshot( const snapshot& );
+			snapshot& operator=( const snapshot& );
+
+			std::atomic< boost::uint64_t >* slot_;
+			const Array* array_;
+		};
+
+	public:
+		concurrent_array2d( size_type rows, size_type cols )
+			: current_( new Array( rows, cols ) ), epoch_( 1 )
+		{
+			_clear_slots();
+		}
+
+		explicit concurrent_array2d( Array&& initial )
+			: current_( new Array( std::move( initial ) ) ), epoch_( 1 )
+		{
+			_clear_slots();
+		}
+
+		~concurrent_array2d()
+		{
+			delete current_.load( std::memory_order_relaxed );
+			for( std::size_t i = 0; i < retired_.size(); ++i ) {
+				delete retired_[i].second;
+			}
+		}
+
+		// Thread-safe, lock-free unless all slots are taken.
+		snapshot read() const
+		{
+			const std::size_t start = std::hash< std::thread::id >()( std::this_thread::get_id() ) % ReaderSlots;
+			for( std::size_t i = start;; ) {
+				boost::uint64_t idle = 0;
+				// the slot is stamped before the pointer is loaded; see _reclaim
+				if( slots_[i].epoch.compare_exchange_strong( idle, epoch_.load( std::memory_order_seq_cst ), std::memory_order_seq_cst ) ) {
+					return snapshot( &slots_[i].epoch, current_.load( std::memory_order_seq_cst ) );
+				}
+				i = (i + 1) % ReaderSlots;
+				if( i == start ) {
+					std::this_thread::yield();
+				}
+			}
+		}
+
+		// Writer side. Each call publishes a new version.
+		void resize( size_type rows, size_type cols )
+		{
+			update( [=]( Array& next ) { next.resize( rows, cols ); } );
+		}
+
+		void reserve( size_type rows, size_type cols )
+		{
+			update( [=]( Array& next ) { next.reserve( rows, cols ); } );
+		}
+
+		void reshape( size_type rows, size_type cols )
+		{
+			update( [=]( Array& next ) { next.reshape( rows, cols ); } );
+		}
+
+		// Calls f on a copy of the current version and publishes the copy.
+		template< typename Function >
+		void update( Function f )
+		{
+			std::lock_guard< std::mutex > lock( writer_mutex_ );
+			Array* next = new Array( *current_.load( std::memory_order_relaxed ) );
+			try {
+				f( *next );
+			} catch( ... ) {
+				delete next;
+				throw;
+			}
+			_publish( next );
+		}
+
+		// Replaces the current version.
+		void assign( Array&& next )
+		{
+			std::lock_guard< std::mutex > lock( writer_mutex_ );
+			_publish( new Array( std::move( next ) ) );
+		}
+
+		// Deletes retired versions no reader can still see. Runs after every
+		// publish; call it again to free versions a slow reader held on to.
+		void reclaim()
+		{
+			std::lock_guard< std::mutex > lock( writer_mutex_ );
+			_reclaim();
+		}
+
+		// Number of retired versions not yet deleted.
+		std::size_t retired() const
+		{
+			std::lock_guard< std::mutex > lock( writer_mutex_ );
+			return retired_.size();
+		}
+
+	private:
+		concurrent_array2d( const concurrent_array2d& );
+		concurrent_array2d& operator=( const concurrent_array2d& );
+
+		void _clear_slots()
+		{
+			for( std::size_t i = 0; i < ReaderSlots; ++i ) {
+				slots_[i].epoch.store( 0, std::memory_order_relaxed );
+			}
+		}
+
+		void _publish( Array* next )
+		{
+			Array* old = current_.exchange( next, std::memory_order_seq_cst );
+			const boost::uint64_t retire_epoch = epoch_.fetch_add( 1, std::memory_order_seq_cst ) + 1;
+			retired_.push_back( std::make_pair( retire_epoch, old ) );
+			_reclaim();
+		}
+
+		// A reader stamped with epoch e >= E read the epoch after it became E,
+		// so after the pointer swap that preceded it, and loaded a newer
+		// version. A reader that stamps its slot after this scan likewise
+		// loads the pointer after the swap. So a version retired at E is
+		// unreachable once no slot holds an epoch below E.
+		void _reclaim()
+		{
+			boost::uint64_t oldest = (std::numeric_limits< boost::uint64_t >::max)();
+			for( std::size_t i = 0; i < ReaderSlots; ++i ) {
+				const boost::uint64_t e = slots_[i].epoch.load( std::memory_order_seq_cst );
+				if( e != 0 ) {
+					oldest = std::min( oldest, e );
+				}
+			}
+
+			std::size_t kept = 0;
+			for( std::size_t i = 0; i < retired_.size(); ++i ) {
+				if( retired_[i].first <= oldest ) {
+					delete retired_[i].second;
+				} else {
+					retired_[kept++] = retired_[i];
+				}
+			}
+			retired_.resize( kept );
+		}
+
+		std::atomic< Array* > current_;
+		std::atomic< boost::uint64_t > epoch_;
+		mutable reader_slot slots_[ ReaderSlots ];
+
+		mutable std::mutex writer_mutex_;
+		std::vector< std::pair< boost::uint64_t, Array* > > retired_;
+	};
+
+}
@@ -0,0 +1,319 @@
+#pragma once
+#include <na_containers/na_vector.h>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <boost/iterator/iterator_facade.hpp>
+#include <boost/integer/static_log2.hpp>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace na {
+
+	namespace detail {
+
+		inline std::size_t floor_log2( std::size_t value )
+		{
+#if defined(_MSC_VER) && defined(_WIN64)
+			unsigned long index;
+			_BitScanReverse64( &index, value );
+			return index;
+#elif defined(_MSC_VER)
+			unsigned long index;
+			_BitScanReverse( &index, value );
+			return index;
+#else
+			return sizeof(unsigned long long) * 8 - 1 - __builtin_clzll( value );
+#endif
+		}
+
+		template< typename Vector, typename ValueType >
+		class concurrent_iterator
+			: public boost::iterator_facade< concurrent_iterator< Vector, ValueType >,
+											 ValueType,
+											 std::random_access_iterator_tag >
+		{
+		public:
+			typedef typename concurrent_iterator::iterator_facade_::reference reference;
+			typedef typename concurrent_iterator::iterator_facade_::difference_type difference_type;
+
+			concurrent_iterator()
+				: vector_( nullptr ), index_( 0 )
+			{
+			}
+
+			concurrent_iterator( const Vector* vector, std::size_t index )
+				: vector_( vector ), index_( index )
+			{
+			}
+
+			reference dereference() const
+			{
+				return (*vector_)[index_];
+			}
+
+			void increment()
+			{
+				++index_;
+			}
+
+			void decrement()
+			{
+				--index_;
+			}
+
+			bool equal( const concurrent_iterator& other ) const
+			{
+				return index_ == other.index_;
+			}
+
+			difference_type distance_to( const concurrent_iterator& other ) const
+			{
+				return difference_type(other.index_) - difference_type(index_);
+			}
+
+			void advance( difference_type diff )
+			{
+				index_ += diff;
+			}
+
+		private:
+			const Vector* vector_;
+			std::size_t index_;
+		};
+
+	}
+
+	// Append-only na vector for many concurrent producers.
+	//
+	// push_back reserves a slot with one fetch_add on an atomic cursor and
+	// writes the element in place; there is no lock. Storage is a fixed table
+	// of segments of geometrically growing size (FirstSegment, FirstSegment,
+	// 2*FirstSegment, 4*FirstSegment, ...), allocated on first use by whichever
+	// producer gets there first. Published elements are never moved.
+	//
+	// Every slot has a ready flag. After writing, a producer advances the
+	// published size over all consecutive ready slots, helping out slower
+	// producers' neighbours, so size() is always a prefix in which every
+	// element is fully written. Readers may run concurrently with producers
+	// and see exactly the elements in [0, size()).
+	//
+	// Destruction and clear() must not race with anything else.
+	template< typename ValueType, class NaPolicy = policies::NaPolicySV< ValueType >,
+			  std::size_t FirstSegment = 4096 >
+	class na_concurrent_vector : private NaPolicy {
+		static_assert( FirstSegment != 0 && (FirstSegment & (FirstSegment - 1)) == 0, "FirstSegment must be a power of two" );
+
+	public:
+		typedef NaPolicy policy_type;
+		typedef typename NaPolicy::value_type value_type;
+
+		typedef const value_type& const_reference;
+		typedef std::size_t size_type;
+		typedef std::ptrdiff_t difference_type;
+
+		typedef detail::concurrent_iterator< na_concurrent_vector, const value_type > const_iterator;
+		typedef const_iterator iterator;
+
+	public:
+		static value_type get_na() {
+			return NaPolicy::get_na();
+		}
+
+	public:
+		na_concurrent_vector()
+			: reserved_( 0 ), published_( 0 )
+		{
+			for( size_type i = 0; i < max_segments; ++i ) {
+				segments_[i].store( nullptr, std::memory_order_relaxed );
+			}
+		}
+
+		~na_concurrent_vector()
+		{
+			clear();
+		}
+
+		// Thread-safe. Returns the index the value was stored at.
+		size_type push_back( const value_type& val )
+		{
+			const size_type index = reserved_.fetch_add( 1, std::memory_order_relaxed );
+			segment* seg = _get_segment( _segment_of( index ) );
+			const size_type offset = index - _segment_begin( _segment_of( index ) );
+
+			::new( static_cast< void* >( seg->data + offset ) ) value_type( val );
+			seg->ready[offset].store( 1, std::memory_order_seq_cst );
+
+			_advance_published();
+			return index;
+		}
+
+		size_type push_back( detail::_na_type )
+		{
+			return push_back( get_na() );
+		}
+
+		// Number of published elements. Everything below is safe to read.
+		size_type size() const
+		{
+			return published_.load( std::memory_order_acquire );
+		}
+
+		bool empty() const
+		{
+			return size() == 0;
+		}
+
+		const_reference operator[]( size_type index ) const
+		{
+			const size_type seg = _segment_of( index );
+			return segments_[seg].load( std::memory_order_acquire )->data[ index - _segment_begin( seg ) ];
+		}
+
+		// Iterates the prefix published at the time of the call.
+		const_iterator begin() const
+		{
+			return const_iterator( this, 0 );
+		}
+
+		const_iterator end() const
+		{
+			return const_iterator( this, size() );
+		}
+
+		const_iterator cbegin() const
+		{
+			return begin();
+		}
+
+		const_iterator cend() const
+		{
+			return end();
+		}
+
+		// Calls f( first, last ) for the published prefix, one contiguous
+		// range per segment.
+		template< typename Function >
+		Function for_each_segment( Function f ) const
+		{
+			const size_type count = size();
+			for( size_type seg = 0; seg < max_segments && _segment_begin( seg ) < count; ++seg ) {
+				const value_type* data = segments_[seg].load( std::memory_order_acquire )->data;
+				const size_type length = std::min( _segment_size( seg ), count - _segment_begin( seg ) );
+				f( data, data + length );
+			}
+			return f;
+		}
+
+		// Not thread-safe.
+		void clear()
+		{
+			const size_type count = size();
+			for( size_type seg = 0; seg < max_segments; ++seg ) {
+				segment* s = segments_[seg].load( std::memory_order_relaxed );
+				if( !s ) {
+					continue;
+				}
+				const size_type begin = _segment_begin( seg );
+				for( size_type i = begin; i < count && i < begin + _segment_size( seg ); ++i ) {
+					s->data[ i - begin ].~value_type();
+				}
+				_free_segment( s, _segment_size( seg ) );
+				segments_[seg].store( nullptr, std::memory_order_relaxed );
+			}
+			reserved_.store( 0 );
+			published_.store( 0 );
+		}
+
+	private:
+		// copying or moving while producers run can not be made safe
+		na_concurrent_vector( const na_concurrent_vector& );
+		na_concurrent_vector& operator=( const na_concurrent_vector& );
+
+		static const size_type first_shift  = boost::static_log2< FirstSegment >::value;
+		static const size_type max_segments = sizeof(size_type) * 8 - first_shift + 1;
+
+		struct segment {
+			value_type* data;
+			std::atomic< unsigned char >* ready;
+		};
+
+		// segment 0 holds [0, FirstSegment), segment k > 0 holds
+		// [FirstSegment << (k-1), FirstSegment << k)
+		static size_type _segment_of( size_type index )
+		{
+			return index < FirstSegment ? 0 : detail::floor_log2( index >> first_shift ) + 1;
+		}
+
+		static size_type _segment_begin( size_type seg )
+		{
+			return seg == 0 ? 0 : size_type(FirstSegment) << (seg - 1);
+		}
+
+		static size_type _segment_size( size_type seg )
+		{
+			return seg == 0 ? size_type(FirstSegment) : size_type(FirstSegment) << (seg - 1);
+		}
+
+		segment* _get_segment( size_type seg )
+		{
+			segment* result = segments_[seg].load( std::memory_order_acquire );
+			if( result ) {
+				return result;
+			}
+
+			segment* fresh = _allocate_segment( _segment_size( seg ) );
+			if( segments_[seg].compare_exchange_strong( result, fresh, std::memory_order_acq_rel, std::memory_order_acquire ) ) {
+				return fresh;
+			}
+
+			// somebody else installed it first
+			_free_segment( fresh, _segment_size( seg ) );
+			return result;
+		}
+
+		static segment* _allocate_segment( size_type length )
+		{
+			std::allocator< value_type > alloc;
+			segment* result = new segment;
+			result->data  = alloc.allocate( length );
+			result->ready = new std::atomic< unsigned char >[ length ];
+			for( size_type i = 0; i < length; ++i ) {
+				result->ready[i].store( 0, std::memory_order_relaxed );
+			}
+			return result;
+		}
+
+		static void _free_segment( segment* seg, size_type length )
+		{
+			std::allocator< value_type > alloc;
+			alloc.deallocate( seg->data, length );
+			delete[] seg->ready;
+			delete seg;
+		}
+
+		bool _is_ready( size_type index ) const
+		{
+			const size_type seg = _segment_of( index );
+			const segment* s = segments_[seg].load( std::memory_order_acquire );
+			return s && s->ready[ index - _segment_begin( seg ) ].load( std::memory_order_seq_cst );
+		}
+
+		void _advance_published()
+		{
+			size_type current = published_.load( std::memory_order_seq_cst );
+			while( current < reserved_.load( std::memory_order_relaxed ) && _is_ready( current ) ) {
+				// on failure current is reloaded and the scan resumes from there
+				if( published_.compare_exchange_weak( current, current + 1, std::memory_order_seq_cst ) ) {
+					++current;
+				}
+			}
+		}
+
+		std::atomic< size_type > reserved_;
+		std::atomic< size_type > published_;
+		std::atomic< segment* >  segments_[ max_segments ];
+	};
+
+}
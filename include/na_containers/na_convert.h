@@ -0,0 +1,85 @@
+#pragma once
+#include <na_containers/na_vector.h>
+#include <na_containers/array2d.h>
+#include <type_traits>
+
+// Conversion between NA encodings, e.g. from NaPolicyOptional<double> to
+// NaPolicySV<double> or to NaPolicyNaN<double>, and between value types.
+//
+// Each element is mapped by a select rather than a branch:
+//   to[i] = is_na( from[i] ) ? To::get_na() : make( get( from[i] ) )
+// so between special-value policies the loop is a compare and a blend over
+// data() and vectorizes. Optional sources still test every element, since
+// the value of an empty optional cannot be read.
+//
+// A non-NA value that happens to equal the target's sentinel (-FLT_MAX into
+// NaPolicySV<float>, say) becomes NA; there is no way to represent it.
+
+namespace na {
+
+	namespace detail {
+
+		template< typename FromPolicy, typename ToPolicy >
+		struct policy_converter {
+			typedef typename FromPolicy::value_type from_type;
+			typedef typename ToPolicy::value_type to_type;
+			typedef na_value_traits< from_type > from_traits;
+			typedef na_value_traits< to_type > to_traits;
+
+			static void run( const from_type* from, to_type* to, std::size_t count )
+			{
+				const to_type na = ToPolicy::get_na();
+				for( std::size_t i = 0; i < count; ++i ) {
+					const bool is_na = FromPolicy::is_na( from[i] );
+					to[i] = is_na ? na : to_traits::make( typename to_traits::raw_type( _get( from[i], is_na ) ) );
+				}
+			}
+
+		private:
+			// Plain values can always be read; an empty optional cannot.
+			static typename from_traits::raw_type _get( const from_type& val, bool is_na )
+			{
+				return _get( val, is_na, std::is_same< from_type, typename from_traits::raw_type >() );
+			}
+
+			static typename from_traits::raw_type _get( const from_type& val, bool, std::true_type )
+			{
+				return val;
+			}
+
+			static typename from_traits::raw_type _get( const from_type& val, bool is_na, std::false_type )
+			{
+				return is_na ? typename from_traits::raw_type() : from_traits::get( val );
+			}
+		};
+
+	}
+
+	// Copy of from in the encoding of To, another na_vector type.
+	template< typename To, typename From >
+	To convert( const From& from )
+	{
+		To result;
+		result.resize_default_init( from.size() );
+		detail::policy_converter< typename From::policy_type, typename To::policy_type >::run( from.data(), result.data(), from.size() );
+		return result;
+	}
+
+	// Copy of an array2d with another container type (and so NA policy or
+	// value type), converted slice by slice over contiguous memory. Both
+	// arrays have to use the same order.
+	template< typename ToArray, typename FromArray >
+	ToArray convert_array( const FromArray& from )
+	{
+		static_assert( std::is_same< typename ToArray::order_type, typename FromArray::order_type >::value, "convert_array needs arrays of the same order" );
+
+		typedef detail::policy_converter< typename detail::array_policy< FromArray >::type, typename detail::array_policy< ToArray >::type > converter;
+
+		ToArray result( from.rows(), from.cols() );
+		for( std::size_t i = 0; i < from.minor_size(); ++i ) {
+			converter::run( from.data() + i * from.stride(), result.data() + i * result.stride(), from.major_size() );
+		}
+		return result;
+	}
+
+}
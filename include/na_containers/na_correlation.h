@@ -0,0 +1,290 @@
+#pragma once
+#include <na_containers/na_vector.h>
+#include <na_containers/array2d.h>
+#include <na_containers/array2d_stats.h>
+#include <na_containers/parallel.h>
+#include <na_containers/platform.h>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+// Covariance and correlation matrices between the columns of an array2d,
+// pairwise complete: the entry for columns a and b uses exactly the rows in
+// which both are non-NA (means and variances included, as R's
+// use = "pairwise.complete.obs"). Entries with fewer than two such rows are
+// NA, and so are correlations involving a constant column.
+//
+// The columns are first copied into a dense buffer, shifted by their means
+// (which keeps the one-pass sums accurate), with NA replaced by 0 and a
+// 0/1 presence mask next to it. Every pair then needs six sums over the rows
+// (count, both sums, both sums of squares and the cross product), all of
+// them products of the value and mask columns. Pairs are grouped into tiles
+// of pair_tile x pair_tile columns that are processed a block of rows at a
+// time, so the columns of a tile stay in cache; tiles run in parallel. Pairs
+// of two columns without NA only need the cross product, the rest comes
+// from per-column totals. With AVX2 the row loops run four rows at a time.
+
+namespace na {
+
+	namespace detail {
+
+		const std::size_t pair_tile = 32;
+		const std::size_t pair_row_block = 1024;
+
+		struct pair_sums {
+			double n, sa, sb, saa, sbb, sab;
+		};
+
+		inline double pair_dot( const double* xa, const double* xb, std::size_t count )
+		{
+			std::size_t r = 0;
+			double result = 0.0;
+#ifdef NA_HAVE_AVX2
+			__m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+			for( ; r + 8 <= count; r += 8 ) {
+				acc0 = _mm256_add_pd( acc0, _mm256_mul_pd( _mm256_loadu_pd( xa + r ), _mm256_loadu_pd( xb + r ) ) );
+				acc1 = _mm256_add_pd( acc1, _mm256_mul_pd( _mm256_loadu_pd( xa + r + 4 ), _mm256_loadu_pd( xb + r + 4 ) ) );
+			}
+			double lanes[4];
+			_mm256_storeu_pd( lanes, _mm256_add_pd( acc0, acc1 ) );
+			result = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+			for( ; r < count; ++r ) {
+				result += xa[r] * xb[r];
+			}
+			return result;
+		}
+
+		// Adds the six masked sums of rows [0, count) to sums.
+		inline void pair_accumulate( const double* xa, const double* ma, const double* xb, const double* mb, std::size_t count, pair_sums& sums )
+		{
+			std::size_t r = 0;
+#ifdef NA_HAVE_AVX2
+			__m256d n = _mm256_setzero_pd(), sa = n, sb = n, saa = n, sbb = n, sab = n;
+			for( ; r + 4 <= count; r += 4 ) {
+				const __m256d a = _mm256_loadu_pd( xa + r ), b = _mm256_loadu_pd( xb + r );
+				const __m256d wa = _mm256_loadu_pd( ma + r ), wb = _mm256_loadu_pd( mb + r );
+				const __m256d a_b = _mm256_mul_pd( a, wb ), b_a = _mm256_mul_pd( b, wa );
+				n   = _mm256_add_pd( n, _mm256_mul_pd( wa, wb ) );
+				sa  = _mm256_add_pd( sa, a_b );
+				sb  = _mm256_add_pd( sb, b_a );
+				saa = _mm256_add_pd( saa, _mm256_mul_pd( a, a_b ) );
+				sbb = _mm256_add_pd( sbb, _mm256_mul_pd( b, b_a ) );
+				sab = _mm256_add_pd( sab, _mm256_mul_pd( a, b ) );
+			}
+			double lanes[6][4];
+			_mm256_storeu_pd( lanes[0], n );
+			_mm256_storeu_pd( lanes[1], sa );
+			_mm256_storeu_pd( lanes[2], sb );
+			_mm256_storeu_pd( lanes[3], saa );
+			_mm256_storeu_pd( lanes[4], sbb );
+			_mm256_storeu_pd( lanes[5], sab );
+			sums.n   += (lanes[0][0] + lanes[0][1]) + (lanes[0][2] + lanes[0][3]);
+			sums.sa  += (lanes[1][0] + lanes[1][1]) + (lanes[1][2] + lanes[1][3]);
+			sums.sb  += (lanes[2][0] + lanes[2][1]) + (lanes[2][2] + lanes[2][3]);
+			sums.saa += (lanes[3][0] + lanes[3][1]) + (lanes[3][2] + lanes[3][3]);
+			sums.sbb += (lanes[4][0] + lanes[4][1]) + (lanes[4][2] + lanes[4][3]);
+			sums.sab += (lanes[5][0] + lanes[5][1]) + (lanes[5][2] + lanes[5][3]);
+#endif
+			for( ; r < count; ++r ) {
+				const double a_b = xa[r] * mb[r], b_a = xb[r] * ma[r];
+				sums.n   += ma[r] * mb[r];
+				sums.sa  += a_b;
+				sums.sb  += b_a;
+				sums.saa += xa[r] * a_b;
+				sums.sbb += xb[r] * b_a;
+				sums.sab += xa[r] * xb[r];
+			}
+		}
+
+		// Columns of an array as dense, mean-shifted doubles with NA as 0,
+		// their presence masks and per-column totals.
+		class pair_columns {
+		public:
+			template< typename Array >
+			explicit pair_columns( const Array& arr )
+				: rows_( arr.rows() ), cols_( arr.cols() ),
+				  values_( rows_ * cols_, 0.0 ), mask_( rows_ * cols_, 0.0 ),
+				  complete_( cols_ ), sum_( cols_, 0.0 ), sum_sq_( cols_, 0.0 )
+			{
+				const std::vector< slice_stats< typename Array::value_type > > stats = column_stats( arr );
+				std::vector< double > shift( cols_, 0.0 );
+				for( std::size_t c = 0; c < cols_; ++c ) {
+					complete_[c] = stats[c].na_count == 0;
+					shift[c] = stats[c].count ? stats[c].mean : 0.0;
+				}
+
+				_pack( arr, shift, typename Array::column_tag() );
+
+				for( std::size_t c = 0; c < cols_; ++c ) {
+					const double* x = values( c );
+					for( std::size_t r = 0; r < rows_; ++r ) {
+						sum_[c] += x[r];
+						sum_sq_[c] += x[r] * x[r];
+					}
+				}
+			}
+
+			std::size_t rows() const { return rows_; }
+			std::size_t cols() const { return cols_; }
+			const double* values( std::size_t c ) const { return values_.data() + c * rows_; }
+			const double* mask( std::size_t c ) const { return mask_.data() + c * rows_; }
+			bool complete( std::size_t c ) const { return complete_[c] != 0; }
+			double sum( std::size_t c ) const { return sum_[c]; }
+			double sum_sq( std::size_t c ) const { return sum_sq_[c]; }
+
+		private:
+			template< typename Array >
+			static double _get( const typename Array::value_type& val, bool is_na )
+			{
+				return is_na ? 0.0 : double( na_value_traits< typename Array::value_type >::get( val ) );
+			}
+
+			// Columns are major slices: copy each.
+			template< typename Array >
+			void _pack( const Array& arr, const std::vector< double >& shift, tags::major_tag )
+			{
+				typedef typename array_policy< Array >::type policy;
+				for( std::size_t c = 0; c < cols_; ++c ) {
+					const typename Array::value_type* col = arr.data() + c * arr.stride();
+					double* x = values_.data() + c * rows_;
+					double* m = mask_.data() + c * rows_;
+					for( std::size_t r = 0; r < rows_; ++r ) {
+						const bool is_na = policy::is_na( col[r] );
+						x[r] = is_na ? 0.0 : _get< Array >( col[r], is_na ) - shift[c];
+						m[r] = is_na ? 0.0 : 1.0;
+					}
+				}
+			}
+
+			// Rows are major slices: distribute each over the columns.
+			template< typename Array >
+			void _pack( const Array& arr, const std::vector< double >& shift, tags::minor_tag )
+			{
+				typedef typename array_policy< Array >::type policy;
+				for( std::size_t r = 0; r < rows_; ++r ) {
+					const typename Array::value_type* row = arr.data() + r * arr.stride();
+					for( std::size_t c = 0; c < cols_; ++c ) {
+						const bool is_na = policy::is_na( row[c] );
+						values_[ c * rows_ + r ] = is_na ? 0.0 : _get< Array >( row[c], is_na ) - shift[c];
+						mask_[ c * rows_ + r ] = is_na ? 0.0 : 1.0;
+					}
+				}
+			}
+
+			std::size_t rows_;
+			std::size_t cols_;
+			std::vector< double > values_;
+			std::vector< double > mask_;
+			std::vector< char > complete_;
+			std::vector< double > sum_;
+			std::vector< double > sum_sq_;
+		};
+
+		enum pair_statistic {
+			pair_covariance,
+			pair_correlation
+		};
+
+		inline double pair_result( const pair_sums& s, pair_statistic statistic, bool diagonal )
+		{
+			const double na = na_vector< double >::get_na();
+			if( s.n < 2.0 ) {
+				return na;
+			}
+			const double cross = s.sab - s.sa * s.sb / s.n;
+			if( statistic == pair_covariance ) {
+				return cross / (s.n - 1.0);
+			}
+			const double va = s.saa - s.sa * s.sa / s.n, vb = s.sbb - s.sb * s.sb / s.n;
+			if( !(va > 0.0) || !(vb > 0.0) ) {
+				return na;
+			}
+			return diagonal ? 1.0 : std::max( -1.0, std::min( 1.0, cross / std::sqrt( va * vb ) ) );
+		}
+
+		// All pairs a in tile ta, b in tile tb (b >= a), a block of rows at a
+		// time; writes both ( a, b ) and ( b, a ).
+		template< typename Result >
+		void pair_tile_pass( const pair_columns& columns, std::size_t ta, std::size_t tb, pair_statistic statistic, Result& result )
+		{
+			const std::size_t rows = columns.rows(), cols = columns.cols();
+			const std::size_t a0 = ta * pair_tile, a1 = std::min( a0 + pair_tile, cols );
+			const std::size_t b0 = tb * pair_tile, b1 = std::min( b0 + pair_tile, cols );
+			const pair_sums zero = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+			std::vector< pair_sums > sums( pair_tile * pair_tile, zero );
+
+			for( std::size_t r0 = 0; r0 < rows; r0 += pair_row_block ) {
+				const std::size_t count = std::min( pair_row_block, rows - r0 );
+				for( std::size_t a = a0; a < a1; ++a ) {
+					for( std::size_t b = std::max( a, b0 ); b < b1; ++b ) {
+						pair_sums& s = sums[ (a - a0) * pair_tile + (b - b0) ];
+						if( columns.complete( a ) && columns.complete( b ) ) {
+							s.sab += pair_dot( columns.values( a ) + r0, columns.values( b ) + r0, count );
+						} else {
+							pair_accumulate( columns.values( a ) + r0, columns.mask( a ) + r0, columns.values( b ) + r0, columns.mask( b ) + r0, count, s );
+						}
+					}
+				}
+			}
+
+			typename Result::value_type* out = result.data();
+			for( std::size_t a = a0; a < a1; ++a ) {
+				for( std::size_t b = std::max( a, b0 ); b < b1; ++b ) {
+					pair_sums s = sums[ (a - a0) * pair_tile + (b - b0) ];
+					if( columns.complete( a ) && columns.complete( b ) ) {
+						s.n = double( rows );
+						s.sa = columns.sum( a );
+						s.sb = columns.sum( b );
+						s.saa = columns.sum_sq( a );
+						s.sbb = columns.sum_sq( b );
+					}
+					const double value = pair_result( s, statistic, a == b );
+					out[ result.to_index( a, b ) ] = value;
+					out[ result.to_index( b, a ) ] = value;
+				}
+			}
+		}
+
+		template< typename Array >
+		array2d< na_vector< double >, typename Array::order_type > pairwise( const Array& arr, pair_statistic statistic, const parallel_t& par )
+		{
+			typedef array2d< na_vector< double >, typename Array::order_type > result_type;
+
+			const pair_columns columns( arr );
+			result_type result( columns.cols(), columns.cols() );
+
+			const std::size_t tiles = (columns.cols() + pair_tile - 1) / pair_tile;
+			std::vector< std::pair< std::size_t, std::size_t > > tile_pairs;
+			for( std::size_t ta = 0; ta < tiles; ++ta ) {
+				for( std::size_t tb = ta; tb < tiles; ++tb ) {
+					tile_pairs.push_back( std::make_pair( ta, tb ) );
+				}
+			}
+
+			parallel_for( tile_pairs.size(), 1, par, [&]( std::size_t first, std::size_t last ) {
+				for( std::size_t t = first; t < last; ++t ) {
+					pair_tile_pass( columns, tile_pairs[t].first, tile_pairs[t].second, statistic, result );
+				}
+			} );
+			return result;
+		}
+
+	}
+
+	// cols() x cols() matrices of pairwise-complete sample covariances and
+	// Pearson correlations. The default parallel_t( 1 ) runs serially.
+	template< typename Array >
+	array2d< na_vector< double >, typename Array::order_type > covariance( const Array& arr, const parallel_t& par = parallel_t( 1 ) )
+	{
+		return detail::pairwise( arr, detail::pair_covariance, par );
+	}
+
+	template< typename Array >
+	array2d< na_vector< double >, typename Array::order_type > correlation( const Array& arr, const parallel_t& par = parallel_t( 1 ) )
+	{
+		return detail::pairwise( arr, detail::pair_correlation, par );
+	}
+
+}
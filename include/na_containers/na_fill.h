@@ -0,0 +1,435 @@
+#pragma once
+#include <na_containers/na_vector.h>
+#include <na_containers/array2d.h>
+#include <algorithm>
+#include <vector>
+
+// Gap filling for na_vector and for the row or column slices of an array2d.
+//
+//   ffill        - carry the last non-NA value forward
+//   bfill        - carry the next non-NA value backward
+//   fill_value   - replace NA by a fixed value
+//   interpolate  - linear interpolation between the surrounding non-NA values
+//
+// Every operation takes a limit: at most that many consecutive NAs of a gap
+// are filled, counted from the side the fill comes from. The _copy variants
+// leave the argument alone and return a filled copy.
+//
+// Contiguous data is scanned in blocks, and blocks without NA are skipped
+// after one branch-free check. Slices that are strided in memory are not
+// walked one by one: the array is swept in storage order with one fill state
+// per slice, so the inner loop runs over contiguous memory and is a plain
+// compare-and-blend for special-value policies.
+
+namespace na {
+
+	const std::size_t no_limit = std::size_t(-1);
+
+	namespace detail {
+
+		const std::size_t fill_block_size = 256;
+
+		template< typename Policy, typename ValueType >
+		bool any_na( const ValueType* data, std::size_t count )
+		{
+			bool result = false;
+			for( std::size_t i = 0; i < count; ++i ) {
+				result |= Policy::is_na( data[i] );
+			}
+			return result;
+		}
+
+		// Scans count elements starting at data (step +1 or -1) and fills NAs
+		// with the last non-NA value seen in scan direction.
+		template< typename Policy, typename ValueType >
+		void carry_fill( ValueType* data, std::size_t count, std::ptrdiff_t step, std::size_t limit )
+		{
+			ValueType fill = Policy::get_na();
+			std::size_t run = 0;
+
+			while( count ) {
+				const std::size_t block = std::min( count, fill_block_size );
+				ValueType* const block_first = step > 0 ? data : data - (block - 1);
+
+				if( !any_na< Policy >( block_first, block ) ) {
+					fill = data[ step * std::ptrdiff_t(block - 1) ];
+					run = 0;
+				} else {
+					for( std::size_t i = 0; i < block; ++i ) {
+						ValueType& elem = data[ step * std::ptrdiff_t(i) ];
+						const bool na = Policy::is_na( elem );
+						run  = na ? run + 1 : 0;
+						fill = na ? fill : elem;
+						elem = (na && run <= limit) ? fill : elem;
+					}
+				}
+
+				data  += step * std::ptrdiff_t(block);
+				count -= block;
+			}
+		}
+
+		// Same as carry_fill for `lanes` interleaved sequences: element k of
+		// lane j lives at data[k*stride + j]. Walks k in scan direction.
+		template< typename Policy, typename ValueType >
+		void carry_fill_lanes( ValueType* data, std::size_t lanes, std::size_t length, std::size_t stride, bool forward, std::size_t limit )
+		{
+			std::vector< ValueType > fill( lanes, Policy::get_na() );
+			std::vector< std::size_t > run( lanes, 0 );
+
+			for( std::size_t n = 0; n < length; ++n ) {
+				ValueType* slice = data + (forward ? n : length - 1 - n) * stride;
+				for( std::size_t j = 0; j < lanes; ++j ) {
+					const bool na = Policy::is_na( slice[j] );
+					run[j]  = na ? run[j] + 1 : 0;
+					fill[j] = na ? fill[j] : slice[j];
+					slice[j] = (na && run[j] <= limit) ? fill[j] : slice[j];
+				}
+			}
+		}
+
+		template< typename Policy, typename ValueType >
+		void value_fill( ValueType* data, std::size_t count, const ValueType& value )
+		{
+			for( std::size_t i = 0; i < count; ++i ) {
+				data[i] = Policy::is_na( data[i] ) ? value : data[i];
+			}
+		}
+
+		template< typename Policy, typename ValueType >
+		void value_fill_lanes( ValueType* data, std::size_t lanes, std::size_t length, std::size_t stride, const ValueType& value, std::size_t limit )
+		{
+			if( limit == no_limit ) {
+				for( std::size_t n = 0; n < length; ++n ) {
+					value_fill< Policy >( data + n * stride, lanes, value );
+				}
+				return;
+			}
+
+			std::vector< std::size_t > run( lanes, 0 );
+			for( std::size_t n = 0; n < length; ++n ) {
+				ValueType* slice = data + n * stride;
+				for( std::size_t j = 0; j < lanes; ++j ) {
+					const bool na = Policy::is_na( slice[j] );
+					run[j] = na ? run[j] + 1 : 0;
+					slice[j] = (na && run[j] <= limit) ? value : slice[j];
+				}
+			}
+		}
+
+		// Fills the gap between the non-NA elements prev and next of a lane
+		// (element k at data[k*stride]). The values are computed in double:
+		// raw arithmetic wraps for unsigned types when the gap descends and
+		// overflows for wide signed ranges.
+		template< typename ValueType >
+		void interpolate_gap( ValueType* data, std::size_t stride, std::size_t prev, std::size_t next, std::size_t limit )
+		{
+			typedef na_value_traits< ValueType > traits;
+			typedef typename traits::raw_type raw_type;
+
+			const double from = double( traits::get( data[ prev * stride ] ) );
+			const double to   = double( traits::get( data[ next * stride ] ) );
+			const double span = double( next - prev );
+			const std::size_t fill_end = limit == no_limit ? next : std::min( next, prev + 1 + limit );
+			for( std::size_t k = prev + 1; k < fill_end; ++k ) {
+				data[ k * stride ] = traits::make( raw_type( from + (to - from) * double( k - prev ) / span ) );
+			}
+		}
+
+		// Linear interpolation over count contiguous elements. A gap is filled
+		// once the non-NA value closing it is reached; leading and trailing
+		// gaps stay NA. NA-free blocks only close a pending gap.
+		template< typename Policy, typename ValueType >
+		void interpolate_run( ValueType* data, std::size_t count, std::size_t limit )
+		{
+			const std::size_t none = std::size_t(-1);
+			std::size_t last = none;
+
+			for( std::size_t first = 0; first < count; ) {
+				const std::size_t block = std::min( count - first, fill_block_size );
+
+				if( !any_na< Policy >( data + first, block ) ) {
+					if( last != none && first - last > 1 ) {
+						interpolate_gap( data, 1, last, first, limit );
+					}
+					last = first + block - 1;
+				} else {
+					for( std::size_t n = first; n < first + block; ++n ) {
+						if( !Policy::is_na( data[n] ) ) {
+							if( last != none && n - last > 1 ) {
+								interpolate_gap( data, 1, last, n, limit );
+							}
+							last = n;
+						}
+					}
+				}
+
+				first += block;
+			}
+		}
+
+		// Same as interpolate_run for `lanes` interleaved sequences: element k
+		// of lane j lives at data[k*stride + j]. A slice without NA that follows
+		// one without NA closes no gap, so it costs one check and only moves
+		// last_clean; the last non-NA index of lane j is max(last[j], last_clean).
+		template< typename Policy, typename ValueType >
+		void interpolate_lanes( ValueType* data, std::size_t lanes, std::size_t length, std::size_t stride, std::size_t limit )
+		{
+			// indices are stored plus one, so 0 means no non-NA value yet
+			std::vector< std::size_t > last( lanes, 0 );
+			std::size_t last_clean = 0;
+			std::size_t open = 0;
+
+			for( std::size_t n = 0; n < length; ++n ) {
+				ValueType* slice = data + n * stride;
+				if( !open && !any_na< Policy >( slice, lanes ) ) {
+					last_clean = n + 1;
+					continue;
+				}
+
+				open = 0;
+				for( std::size_t j = 0; j < lanes; ++j ) {
+					if( Policy::is_na( slice[j] ) ) {
+						++open;
+					} else {
+						const std::size_t prev = std::max( last[j], last_clean );
+						if( prev && n + 1 - prev > 1 ) {
+							interpolate_gap( data + j, stride, prev - 1, n, limit );
+						}
+						last[j] = n + 1;
+					}
+				}
+			}
+		}
+
+		// Slices along the major axis are contiguous: run the 1d kernel on each.
+		// Slices along the minor axis interleave: sweep storage order with lanes.
+		template< typename Array >
+		void carry_fill_slices( Array& arr, tags::major_tag, bool forward, std::size_t limit )
+		{
+			typedef typename array_policy< Array >::type policy;
+			for( std::size_t i = 0; i < arr.minor_size(); ++i ) {
+				typename Array::value_type* slice = arr.data() + i * arr.stride();
+				if( forward ) {
+					carry_fill< policy >( slice, arr.major_size(), 1, limit );
+				} else if( arr.major_size() ) {
+					carry_fill< policy >( slice + arr.major_size() - 1, arr.major_size(), -1, limit );
+				}
+			}
+		}
+
+		template< typename Array >
+		void carry_fill_slices( Array& arr, tags::minor_tag, bool forward, std::size_t limit )
+		{
+			typedef typename array_policy< Array >::type policy;
+			carry_fill_lanes< policy >( arr.data(), arr.major_size(), arr.minor_size(), arr.stride(), forward, limit );
+		}
+
+		template< typename Array >
+		void value_fill_slices( Array& arr, tags::major_tag, const typename Array::value_type& value, std::size_t limit )
+		{
+			typedef typename array_policy< Array >::type policy;
+			for( std::size_t i = 0; i < arr.minor_size(); ++i ) {
+				value_fill_lanes< policy >( arr.data() + i * arr.stride(), 1, arr.major_size(), 1, value, limit );
+			}
+		}
+
+		template< typename Array >
+		void value_fill_slices( Array& arr, tags::minor_tag, const typename Array::value_type& value, std::size_t limit )
+		{
+			typedef typename array_policy< Array >::type policy;
+			value_fill_lanes< policy >( arr.data(), arr.major_size(), arr.minor_size(), arr.stride(), value, limit );
+		}
+
+		template< typename Array >
+		void interpolate_slices( Array& arr, tags::major_tag, std::size_t limit )
+		{
+			typedef typename array_policy< Array >::type policy;
+			for( std::size_t i = 0; i < arr.minor_size(); ++i ) {
+				interpolate_run< policy >( arr.data() + i * arr.stride(), arr.major_size(), limit );
+			}
+		}
+
+		template< typename Array >
+		void interpolate_slices( Array& arr, tags::minor_tag, std::size_t limit )
+		{
+			typedef typename array_policy< Array >::type policy;
+			interpolate_lanes< policy >( arr.data(), arr.major_size(), arr.minor_size(), arr.stride(), limit );
+		}
+
+	}
+
+	// na_vector, in place
+	template< typename Vector >
+	void ffill( Vector& vec, std::size_t limit = no_limit )
+	{
+		detail::carry_fill< typename Vector::policy_type >( vec.data(), vec.size(), 1, limit );
+	}
+
+	template< typename Vector >
+	void bfill( Vector& vec, std::size_t limit = no_limit )
+	{
+		if( !vec.empty() ) {
+			detail::carry_fill< typename Vector::policy_type >( vec.data() + vec.size() - 1, vec.size(), -1, limit );
+		}
+	}
+
+	template< typename Vector >
+	void fill_value( Vector& vec, const typename Vector::value_type& value, std::size_t limit = no_limit )
+	{
+		detail::value_fill_lanes< typename Vector::policy_type >( vec.data(), 1, vec.size(), 1, value, limit );
+	}
+
+	template< typename Vector >
+	void interpolate( Vector& vec, std::size_t limit = no_limit )
+	{
+		detail::interpolate_run< typename Vector::policy_type >( vec.data(), vec.size(), limit );
+	}
+
+	// na_vector, out of place
+	template< typename Vector >
+	Vector ffill_copy( const Vector& vec, std::size_t limit = no_limit )
+	{
+		Vector result( vec );
+		ffill( result, limit );
+		return result;
+	}
+
+	template< typename Vector >
+	Vector bfill_copy( const Vector& vec, std::size_t limit = no_limit )
+	{
+		Vector result( vec );
+		bfill( result, limit );
+		return result;
+	}
+
+	template< typename Vector >
+	Vector fill_value_copy( const Vector& vec, const typename Vector::value_type& value, std::size_t limit = no_limit )
+	{
+		Vector result( vec );
+		fill_value( result, value, limit );
+		return result;
+	}
+
+	template< typename Vector >
+	Vector interpolate_copy( const Vector& vec, std::size_t limit = no_limit )
+	{
+		Vector result( vec );
+		interpolate( result, limit );
+		return result;
+	}
+
+	// array2d: *_cols fills within every column, *_rows within every row.
+	template< typename Array >
+	void ffill_cols( Array& arr, std::size_t limit = no_limit )
+	{
+		detail::carry_fill_slices( arr, typename Array::column_tag(), true, limit );
+	}
+
+	template< typename Array >
+	void ffill_rows( Array& arr, std::size_t limit = no_limit )
+	{
+		detail::carry_fill_slices( arr, typename Array::row_tag(), true, limit );
+	}
+
+	template< typename Array >
+	void bfill_cols( Array& arr, std::size_t limit = no_limit )
+	{
+		detail::carry_fill_slices( arr, typename Array::column_tag(), false, limit );
+	}
+
+	template< typename Array >
+	void bfill_rows( Array& arr, std::size_t limit = no_limit )
+	{
+		detail::carry_fill_slices( arr, typename Array::row_tag(), false, limit );
+	}
+
+	template< typename Array >
+	void fill_value_cols( Array& arr, const typename Array::value_type& value, std::size_t limit = no_limit )
+	{
+		detail::value_fill_slices( arr, typename Array::column_tag(), value, limit );
+	}
+
+	template< typename Array >
+	void fill_value_rows( Array& arr, const typename Array::value_type& value, std::size_t limit = no_limit )
+	{
+		detail::value_fill_slices( arr, typename Array::row_tag(), value, limit );
+	}
+
+	template< typename Array >
+	void interpolate_cols( Array& arr, std::size_t limit = no_limit )
+	{
+		detail::interpolate_slices( arr, typename Array::column_tag(), limit );
+	}
+
+	template< typename Array >
+	void interpolate_rows( Array& arr, std::size_t limit = no_limit )
+	{
+		detail::interpolate_slices( arr, typename Array::row_tag(), limit );
+	}
+
+	template< typename Array >
+	Array ffill_cols_copy( const Array& arr, std::size_t limit = no_limit )
+	{
+		Array result( arr );
+		ffill_cols( result, limit );
+		return result;
+	}
+
+	template< typename Array >
+	Array ffill_rows_copy( const Array& arr, std::size_t limit = no_limit )
+	{
+		Array result( arr );
+		ffill_rows( result, limit );
+		return result;
+	}
+
+	template< typename Array >
+	Array bfill_cols_copy( const Array& arr, std::size_t limit = no_limit )
+	{
+		Array result( arr );
+		bfill_cols( result, limit );
+		return result;
+	}
+
+	template< typename Array >
+	Array bfill_rows_copy( const Array& arr, std::size_t limit = no_limit )
+	{
+		Array result( arr );
+		bfill_rows( result, limit );
+		return result;
+	}
+
+	template< typename Array >
+	Array fill_value_cols_copy( const Array& arr, const typename Array::value_type& value, std::size_t limit = no_limit )
+	{
+		Array result( arr );
+		fill_value_cols( result, value, limit );
+		return result;
+	}
+
+	template< typename Array >
+	Array fill_value_rows_copy( const Array& arr, const typename Array::value_type& value, std::size_t limit = no_limit )
+	{
+		Array result( arr );
+		fill_value_rows( result, value, limit );
+		return result;
+	}
+
+	template< typename Array >
+	Array interpolate_cols_copy( const Array& arr, std::size_t limit = no_limit )
+	{
+		Array result( arr );
+		interpolate_cols( result, limit );
+		return result;
+	}
+
+	template< typename Array >
+	Array interpolate_rows_copy( const Array& arr, std::size_t limit = no_limit )
+	{
+		Array result( arr );
+		interpolate_rows( result, limit );
+		return result;
+	}
+
+}
@@ -0,0 +1,565 @@
+#pragma once
+#include <na_containers/na_vector.h>
+#include <na_containers/array2d.h>
+#include <boost/cstdint.hpp>
+#include <boost/integer.hpp>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// Read-only, compressed copy of an array2d for data that is kept around but
+// rarely read.
+//
+// Every major slice is cut into blocks of block_length elements, and every
+// block is encoded on its own:
+//
+//   NA elements    as runs ( start, length ) next to the values
+//   integers       frame of reference (offset from the block minimum) or
+//                  zigzag deltas from the previous value, whichever packs
+//                  into fewer bits, bit-packed at one width per block
+//   floating point XOR with the previous value, storing only the bits
+//                  between the leading and trailing zeros of the XOR
+//
+// Element access through get(), copy_row() and copy_col() decodes the
+// blocks it needs into a small round-robin cache, so walking a column of a
+// column-major array (a row of a row-major one) decodes every block once.
+// A row of a column-major array touches one block per column; for heavy
+// access, thaw() the array. for_each_element() and thaw() decode block by
+// block into a local buffer and leave the cache alone.
+//
+// The cache makes get(), copy_row() and copy_col() unsafe to call from
+// several threads on the same object; for_each_element() and thaw() are
+// safe.
+
+namespace na {
+
+	namespace detail {
+
+		// Bit fields of up to 64 bits, least significant bit first.
+		class bit_writer {
+		public:
+			explicit bit_writer( std::vector< bit_word >& words )
+				: words_( words ), bit_( 0 )
+			{
+			}
+
+			void write( boost::uint64_t value, std::size_t width )
+			{
+				if( width == 0 ) {
+					return;
+				}
+				if( width < 64 ) {
+					value &= (boost::uint64_t(1) << width) - 1;
+				}
+				const std::size_t offset = bit_ % bit_word_bits;
+				if( offset == 0 ) {
+					words_.push_back( 0 );
+				}
+				words_.back() |= value << offset;
+				if( offset + width > bit_word_bits ) {
+					words_.push_back( value >> (bit_word_bits - offset) );
+				}
+				bit_ += width;
+			}
+
+		private:
+			std::vector< bit_word >& words_;
+			std::size_t bit_;
+		};
+
+		class bit_reader {
+		public:
+			explicit bit_reader( const bit_word* words )
+				: words_( words ), bit_( 0 )
+			{
+			}
+
+			boost::uint64_t read( std::size_t width )
+			{
+				if( width == 0 ) {
+					return 0;
+				}
+				const std::size_t index = bit_ / bit_word_bits, offset = bit_ % bit_word_bits;
+				boost::uint64_t value = words_[index] >> offset;
+				if( offset + width > bit_word_bits ) {
+					value |= words_[index + 1] << (bit_word_bits - offset);
+				}
+				bit_ += width;
+				return width < 64 ? value & ((boost::uint64_t(1) << width) - 1) : value;
+			}
+
+		private:
+			const bit_word* words_;
+			std::size_t bit_;
+		};
+
+		inline std::size_t bit_width( boost::uint64_t value )
+		{
+			return value ? highest_bit( value ) + 1 : 0;
+		}
+
+		enum frozen_codec {
+			frozen_all_na,
+			frozen_reference,	// value - base at `width` bits
+			frozen_delta,		// base, then zigzag deltas at `width` bits
+			frozen_xor			// first value, then XOR with the previous
+		};
+
+		struct frozen_block {
+			boost::uint32_t length;			// elements
+			boost::uint32_t value_count;	// non-NA elements
+			boost::uint8_t codec;
+			boost::uint8_t width;
+			boost::uint64_t base;
+			std::size_t word_offset;		// into the packed words
+			std::size_t run_offset;			// into the NA runs, two entries per run
+			std::size_t run_count;
+		};
+
+		template< typename Raw, bool IsInteger = std::numeric_limits< Raw >::is_integer >
+		struct frozen_codec_traits;
+
+		template< typename Raw >
+		struct frozen_codec_traits< Raw, true > {
+			static boost::uint64_t to_bits( Raw val )
+			{
+				return std::numeric_limits< Raw >::is_signed ? boost::uint64_t( boost::int64_t( val ) ) : boost::uint64_t( val );
+			}
+
+			static Raw from_bits( boost::uint64_t bits )
+			{
+				return std::numeric_limits< Raw >::is_signed ? Raw( boost::int64_t( bits ) ) : Raw( bits );
+			}
+
+			static boost::uint64_t zigzag( boost::uint64_t diff )
+			{
+				const boost::int64_t d = boost::int64_t( diff );
+				return (boost::uint64_t( d ) << 1) ^ boost::uint64_t( d >> 63 );
+			}
+
+			static boost::uint64_t unzigzag( boost::uint64_t z )
+			{
+				return (z >> 1) ^ (boost::uint64_t(0) - (z & 1));
+			}
+
+			static void encode( const Raw* values, std::size_t count, frozen_block& block, std::vector< bit_word >& words )
+			{
+				const Raw lowest = *std::min_element( values, values + count );
+				boost::uint64_t widest_offset = 0, widest_delta = 0;
+				for( std::size_t i = 0; i < count; ++i ) {
+					widest_offset = std::max( widest_offset, to_bits( values[i] ) - to_bits( lowest ) );
+					if( i > 0 ) {
+						widest_delta = std::max( widest_delta, zigzag( to_bits( values[i] ) - to_bits( values[i - 1] ) ) );
+					}
+				}
+
+				const std::size_t reference_width = bit_width( widest_offset ), delta_width = bit_width( widest_delta );
+				bit_writer writer( words );
+				if( reference_width * count <= delta_width * (count - 1) ) {
+					block.codec = frozen_reference;
+					block.width = boost::uint8_t( reference_width );
+					block.base = to_bits( lowest );
+					for( std::size_t i = 0; i < count; ++i ) {
+						writer.write( to_bits( values[i] ) - block.base, reference_width );
+					}
+				} else {
+					block.codec = frozen_delta;
+					block.width = boost::uint8_t( delta_width );
+					block.base = to_bits( values[0] );
+					for( std::size_t i = 1; i < count; ++i ) {
+						writer.write( zigzag( to_bits( values[i] ) - to_bits( values[i - 1] ) ), delta_width );
+					}
+				}
+			}
+
+			static void decode( const frozen_block& block, const bit_word* words, Raw* out )
+			{
+				bit_reader reader( words );
+				if( block.codec == frozen_reference ) {
+					for( std::size_t i = 0; i < block.value_count; ++i ) {
+						out[i] = from_bits( block.base + reader.read( block.width ) );
+					}
+				} else {
+					boost::uint64_t current = block.base;
+					out[0] = from_bits( current );
+					for( std::size_t i = 1; i < block.value_count; ++i ) {
+						current += unzigzag( reader.read( block.width ) );
+						out[i] = from_bits( current );
+					}
+				}
+			}
+		};
+
+		template< typename Raw >
+		struct frozen_codec_traits< Raw, false > {
+			typedef typename boost::uint_t< sizeof(Raw) * 8 >::exact bits_type;
+			static const std::size_t value_bits = sizeof(Raw) * 8;
+
+			static bits_type to_bits( const Raw& val )
+			{
+				bits_type bits;
+				std::memcpy( &bits, &val, sizeof(Raw) );
+				return bits;
+			}
+
+			static Raw from_bits( bits_type bits )
+			{
+				Raw val;
+				std::memcpy( &val, &bits, sizeof(Raw) );
+				return val;
+			}
+
+			// A repeated value costs one bit; otherwise a 1, the number of
+			// leading zeros and of meaningful bits of the XOR (6 bits each),
+			// and the meaningful bits.
+			static void encode( const Raw* values, std::size_t count, frozen_block& block, std::vector< bit_word >& words )
+			{
+				block.codec = frozen_xor;
+				block.width = 0;
+				block.base = to_bits( values[0] );
+
+				bit_writer writer( words );
+				bits_type previous = bits_type( block.base );
+				for( std::size_t i = 1; i < count; ++i ) {
+					const bits_type current = to_bits( values[i] );
+					const bits_type x = current ^ previous;
+					previous = current;
+					if( x == 0 ) {
+						writer.write( 0, 1 );
+						continue;
+					}
+					const std::size_t trailing = lowest_bit( x );
+					const std::size_t leading = value_bits - 1 - highest_bit( x );
+					const std::size_t meaningful = value_bits - leading - trailing;
+					writer.write( 1, 1 );
+					writer.write( leading, 6 );
+					writer.write( meaningful - 1, 6 );
+					writer.write( boost::uint64_t( x ) >> trailing, meaningful );
+				}
+			}
+
+			static void decode( const frozen_block& block, const bit_word* words, Raw* out )
+			{
+				bit_reader reader( words );
+				bits_type current = bits_type( block.base );
+				out[0] = from_bits( current );
+				for( std::size_t i = 1; i < block.value_count; ++i ) {
+					if( reader.read( 1 ) ) {
+						const std::size_t leading = std::size_t( reader.read( 6 ) );
+						const std::size_t meaningful = std::size_t( reader.read( 6 ) ) + 1;
+						const std::size_t trailing = value_bits - leading - meaningful;
+						current ^= bits_type( reader.read( meaningful ) << trailing );
+					}
+					out[i] = from_bits( current );
+				}
+			}
+		};
+
+	}
+
+	template< typename ValueType, typename OrderType = order::column_major,
+			  typename NaPolicy = policies::NaPolicySV< ValueType > >
+	class frozen_array2d {
+		typedef detail::na_value_traits< typename NaPolicy::value_type > traits;
+		typedef typename traits::raw_type raw_type;
+		typedef detail::frozen_codec_traits< raw_type > codec;
+
+		static_assert( std::is_arithmetic< raw_type >::value, "frozen_array2d needs arithmetic values" );
+
+	public:
+		typedef NaPolicy policy_type;
+		typedef typename NaPolicy::value_type value_type;
+		typedef std::size_t size_type;
+		typedef OrderType order_type;
+		typedef typename ::detail::array2d_order< OrderType >::row_tag row_tag;
+		typedef typename ::detail::array2d_order< OrderType >::column_tag column_tag;
+
+		// Compresses src, an array2d (or array2d_fixed, shared_array2d) of the
+		// same order and NA policy.
+		template< typename Array >
+		explicit frozen_array2d( const Array& src, size_type block_length = 4096, size_type cache_blocks = 8 )
+			: major_size_( src.major_size() ), minor_size_( src.minor_size() ),
+			  block_length_( std::max( block_length, size_type(1) ) ),
+			  cache_( std::max( cache_blocks, size_type(1) ) ), next_victim_( 0 )
+		{
+			static_assert( std::is_same< typename Array::order_type, OrderType >::value, "frozen_array2d needs an array of the same order" );
+			static_assert( std::is_same< typename detail::array_policy< Array >::type, NaPolicy >::value, "frozen_array2d needs an array of the same NA policy" );
+
+			if( block_length_ > (std::numeric_limits< boost::uint32_t >::max)() ) {
+				throw std::length_error( "na::frozen_array2d: block length too large" );
+			}
+
+			blocks_per_slice_ = (major_size_ + block_length_ - 1) / block_length_;
+			blocks_.reserve( blocks_per_slice_ * minor_size_ );
+
+			std::vector< raw_type > values;
+			values.reserve( std::min( block_length_, major_size_ ) );
+			for( size_type i = 0; i < minor_size_; ++i ) {
+				const value_type* slice = src.data() + i * src.stride();
+				for( size_type first = 0; first < major_size_; first += block_length_ ) {
+					_encode( slice + first, std::min( block_length_, major_size_ - first ), values );
+				}
+			}
+
+			for( size_type k = 0; k < cache_.size(); ++k ) {
+				cache_[k].block = no_block;
+			}
+		}
+
+		static value_type get_na()
+		{
+			return NaPolicy::get_na();
+		}
+
+		size_type rows() const
+		{
+			return _extent( row_tag() );
+		}
+
+		size_type cols() const
+		{
+			return _extent( column_tag() );
+		}
+
+		size_type major_size() const
+		{
+			return major_size_;
+		}
+
+		size_type minor_size() const
+		{
+			return minor_size_;
+		}
+
+		size_type block_length() const
+		{
+			return block_length_;
+		}
+
+		size_type block_count() const
+		{
+			return blocks_.size();
+		}
+
+		// Bytes held by the encoded form.
+		size_type compressed_bytes() const
+		{
+			return blocks_.size() * sizeof( detail::frozen_block ) + words_.size() * sizeof( detail::bit_word ) + runs_.size() * sizeof( boost::uint32_t );
+		}
+
+		value_type get( size_type row, size_type col ) const
+		{
+			const std::pair< size_type, size_type > pos = _to_major_minor( row, col, order_type() );
+			return _cached( pos.second * blocks_per_slice_ + pos.first / block_length_ )[ pos.first % block_length_ ];
+		}
+
+		bool is_na( size_type row, size_type col ) const
+		{
+			return NaPolicy::is_na( get( row, col ) );
+		}
+
+		// Writes the rows() elements of column col (cols() of row row) to out.
+		template< typename OutputIterator >
+		OutputIterator copy_col( size_type col, OutputIterator out ) const
+		{
+			return _copy_slice( col, out, column_tag() );
+		}
+
+		template< typename OutputIterator >
+		OutputIterator copy_row( size_type row, OutputIterator out ) const
+		{
+			return _copy_slice( row, out, row_tag() );
+		}
+
+		// Calls f( row, col, value ) for every element in storage order.
+		template< typename Function >
+		Function for_each_element( Function f ) const
+		{
+			std::vector< value_type > buffer( std::min( block_length_, major_size_ ) );
+			std::vector< raw_type > values( buffer.size() );
+			for( size_type b = 0; b < blocks_.size(); ++b ) {
+				_decode( blocks_[b], buffer.data(), values );
+				const size_type minor = b / blocks_per_slice_, first = (b % blocks_per_slice_) * block_length_;
+				for( size_type j = 0; j < blocks_[b].length; ++j ) {
+					_visit( f, first + j, minor, buffer[j], order_type() );
+				}
+			}
+			return f;
+		}
+
+		// Decompressed copy as an array2d type of the same order and policy.
+		template< typename Array >
+		Array thaw() const
+		{
+			static_assert( std::is_same< typename Array::order_type, OrderType >::value, "thaw needs an array of the same order" );
+
+			Array result( rows(), cols() );
+			std::vector< raw_type > values( std::min( block_length_, major_size_ ) );
+			for( size_type b = 0; b < blocks_.size(); ++b ) {
+				const size_type minor = b / blocks_per_slice_, first = (b % blocks_per_slice_) * block_length_;
+				_decode( blocks_[b], result.data() + minor * result.stride() + first, values );
+			}
+			return result;
+		}
+
+	private:
+		static const size_type no_block = size_type(-1);
+
+		struct cache_entry {
+			size_type block;
+			std::vector< value_type > values;
+		};
+
+		size_type _extent( tags::major_tag ) const
+		{
+			return minor_size_;
+		}
+
+		size_type _extent( tags::minor_tag ) const
+		{
+			return major_size_;
+		}
+
+		static std::pair< size_type, size_type > _to_major_minor( size_type row, size_type col, order::column_major )
+		{
+			return std::make_pair( row, col );
+		}
+
+		static std::pair< size_type, size_type > _to_major_minor( size_type row, size_type col, order::row_major )
+		{
+			return std::make_pair( col, row );
+		}
+
+		template< typename Function >
+		static void _visit( Function& f, size_type major, size_type minor, const value_type& val, order::column_major )
+		{
+			f( major, minor, val );
+		}
+
+		template< typename Function >
+		static void _visit( Function& f, size_type major, size_type minor, const value_type& val, order::row_major )
+		{
+			f( minor, major, val );
+		}
+
+		void _encode( const value_type* first, size_type length, std::vector< raw_type >& values )
+		{
+			detail::frozen_block block;
+			block.length = boost::uint32_t( length );
+			block.width = 0;
+			block.base = 0;
+			block.word_offset = words_.size();
+			block.run_offset = runs_.size();
+
+			values.clear();
+			for( size_type j = 0; j < length; ) {
+				if( NaPolicy::is_na( first[j] ) ) {
+					const size_type start = j;
+					while( j < length && NaPolicy::is_na( first[j] ) ) {
+						++j;
+					}
+					runs_.push_back( boost::uint32_t( start ) );
+					runs_.push_back( boost::uint32_t( j - start ) );
+				} else {
+					values.push_back( traits::get( first[j] ) );
+					++j;
+				}
+			}
+			block.run_count = (runs_.size() - block.run_offset) / 2;
+			block.value_count = boost::uint32_t( values.size() );
+
+			if( values.empty() ) {
+				block.codec = detail::frozen_all_na;
+			} else {
+				codec::encode( values.data(), values.size(), block, words_ );
+			}
+			blocks_.push_back( block );
+		}
+
+		// Decodes a block into out[0, length); values is scratch space.
+		void _decode( const detail::frozen_block& block, value_type* out, std::vector< raw_type >& values ) const
+		{
+			const value_type na = NaPolicy::get_na();
+			if( block.codec == detail::frozen_all_na ) {
+				std::fill( out, out + block.length, na );
+				return;
+			}
+
+			values.resize( block.value_count );
+			codec::decode( block, words_.data() + block.word_offset, values.data() );
+
+			size_type position = 0, next_value = 0;
+			const boost::uint32_t* run = runs_.data() + block.run_offset;
+			for( size_type r = 0; r < block.run_count; ++r, run += 2 ) {
+				for( ; position < run[0]; ++position ) {
+					out[position] = traits::make( values[next_value++] );
+				}
+				std::fill( out + position, out + position + run[1], na );
+				position += run[1];
+			}
+			for( ; position < block.length; ++position ) {
+				out[position] = traits::make( values[next_value++] );
+			}
+		}
+
+		const value_type* _cached( size_type b ) const
+		{
+			for( size_type k = 0; k < cache_.size(); ++k ) {
+				if( cache_[k].block == b ) {
+					return cache_[k].values.data();
+				}
+			}
+
+			cache_entry& entry = cache_[ next_victim_ ];
+			next_victim_ = (next_victim_ + 1) % cache_.size();
+			entry.values.resize( blocks_[b].length );
+			_decode( blocks_[b], entry.values.data(), scratch_ );
+			entry.block = b;
+			return entry.values.data();
+		}
+
+		// A major slice is its blocks in order.
+		template< typename OutputIterator >
+		OutputIterator _copy_slice( size_type index, OutputIterator out, tags::major_tag ) const
+		{
+			for( size_type k = 0; k < blocks_per_slice_; ++k ) {
+				const size_type b = index * blocks_per_slice_ + k;
+				const value_type* values = _cached( b );
+				out = std::copy( values, values + blocks_[b].length, out );
+			}
+			return out;
+		}
+
+		// A minor slice takes one element from the same block of every major
+		// slice.
+		template< typename OutputIterator >
+		OutputIterator _copy_slice( size_type index, OutputIterator out, tags::minor_tag ) const
+		{
+			const size_type block_in_slice = index / block_length_, offset = index % block_length_;
+			for( size_type i = 0; i < minor_size_; ++i, ++out ) {
+				*out = _cached( i * blocks_per_slice_ + block_in_slice )[ offset ];
+			}
+			return out;
+		}
+
+		size_type major_size_;
+		size_type minor_size_;
+		size_type block_length_;
+		size_type blocks_per_slice_;
+
+		std::vector< detail::frozen_block > blocks_;
+		std::vector< detail::bit_word > words_;
+		std::vector< boost::uint32_t > runs_;
+
+		mutable std::vector< cache_entry > cache_;
+		mutable size_type next_victim_;
+		mutable std::vector< raw_type > scratch_;
+	};
+
+	template< typename ValueType, typename OrderType, typename NaPolicy >
+	const typename frozen_array2d< ValueType, OrderType, NaPolicy >::size_type frozen_array2d< ValueType, OrderType, NaPolicy >::no_block;
+
+}
@@ -0,0 +1,297 @@
+#pragma once
+#include <na_containers/na_vector.h>
+#include <na_containers/array2d.h>
+#include <na_containers/parallel.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+// Cumulative operations (prefix scans) for na_vector and along the rows or
+// columns of an array2d, in place.
+//
+//   cumsum, cumprod, cummax, cummin
+//
+// NA elements stay NA in the result. What happens after them is chosen by
+// na_handling:
+//
+//   na_skip       - the NA is left out, accumulation continues behind it
+//   na_reset      - accumulation starts over behind the NA
+//   na_propagate  - every element from the first NA on is NA
+//
+// The inner loop is one select per element (accumulate the value or the
+// identity, emit the sum or NA), without branches. With a parallel_t of more
+// than one thread a long vector is scanned in two passes: every thread
+// reduces its block, the block carries are combined serially, and every
+// thread scans its block again starting from its carry. Arrays run slices
+// (or, across the storage order, lanes) in parallel instead, with no second
+// pass. Floating point sums of a parallel scan can differ from the serial
+// result in the last bits.
+
+namespace na {
+
+	enum na_handling {
+		na_skip,
+		na_reset,
+		na_propagate
+	};
+
+	namespace scan_ops {
+
+		struct sum {
+			template< typename T > static T identity() { return T(0); }
+			template< typename T > static T apply( const T& a, const T& b ) { return a + b; }
+		};
+
+		struct product {
+			template< typename T > static T identity() { return T(1); }
+			template< typename T > static T apply( const T& a, const T& b ) { return a * b; }
+		};
+
+		struct maximum {
+			template< typename T > static T identity()
+			{
+				return std::numeric_limits< T >::is_integer ? (std::numeric_limits< T >::min)() : -(std::numeric_limits< T >::max)();
+			}
+			template< typename T > static T apply( const T& a, const T& b ) { return a < b ? b : a; }
+		};
+
+		struct minimum {
+			template< typename T > static T identity() { return (std::numeric_limits< T >::max)(); }
+			template< typename T > static T apply( const T& a, const T& b ) { return b < a ? b : a; }
+		};
+
+	}
+
+	namespace detail {
+
+		const std::size_t scan_grain = 1 << 16;
+
+		template< typename T >
+		struct scan_carry {
+			T value;
+			bool na;	// propagate: an NA was seen; reset: the block contained an NA
+		};
+
+		template< typename Policy, typename Op >
+		struct scan_kernel {
+			typedef typename Policy::value_type value_type;
+			typedef na_value_traits< value_type > traits;
+			typedef typename traits::raw_type raw_type;
+			typedef scan_carry< raw_type > carry_type;
+
+			static carry_type identity()
+			{
+				carry_type result;
+				result.value = Op::template identity< raw_type >();
+				result.na = false;
+				return result;
+			}
+
+			static raw_type get( const value_type& val, bool na )
+			{
+				return na ? Op::template identity< raw_type >() : traits::get( val );
+			}
+
+			// Scans `lanes` interleaved sequences of `length` elements (element k
+			// of lane j at data[k*stride + j]) with one carry per lane.
+			static void scan( value_type* data, std::size_t lanes, std::size_t length, std::size_t stride, carry_type* carry, na_handling handling )
+			{
+				const bool reset = handling == na_reset;
+				const bool propagate = handling == na_propagate;
+				const raw_type start = Op::template identity< raw_type >();
+				const value_type na = Policy::get_na();
+
+				for( std::size_t k = 0; k < length; ++k ) {
+					value_type* slice = data + k * stride;
+					for( std::size_t j = 0; j < lanes; ++j ) {
+						const bool is_na = Policy::is_na( slice[j] );
+						const raw_type acc = Op::apply( carry[j].value, get( slice[j], is_na ) );
+						carry[j].value = (reset && is_na) ? start : acc;
+						carry[j].na    = carry[j].na || (propagate && is_na);
+						slice[j] = (is_na || carry[j].na) ? na : traits::make( carry[j].value );
+					}
+				}
+			}
+
+			// Carry of a contiguous block, without writing it: the accumulated
+			// value (behind the last NA for reset) and whether it held an NA.
+			static carry_type reduce( const value_type* data, std::size_t count, na_handling handling )
+			{
+				const bool reset = handling == na_reset;
+				const raw_type start = Op::template identity< raw_type >();
+				carry_type result = identity();
+
+				for( std::size_t i = 0; i < count; ++i ) {
+					const bool is_na = Policy::is_na( data[i] );
+					const raw_type acc = Op::apply( result.value, get( data[i], is_na ) );
+					result.value = (reset && is_na) ? start : acc;
+					result.na    = result.na || is_na;
+				}
+				return result;
+			}
+
+			// Carry after a block with carry `in` and reduction `block`.
+			static carry_type combine( const carry_type& in, const carry_type& block, na_handling handling )
+			{
+				carry_type result;
+				if( handling == na_reset && block.na ) {
+					result.value = block.value;
+					result.na = false;
+				} else {
+					result.value = Op::apply( in.value, block.value );
+					result.na = handling == na_propagate && (in.na || block.na);
+				}
+				return result;
+			}
+		};
+
+		template< typename Policy, typename Op, typename ValueType >
+		void scan_contiguous( ValueType* data, std::size_t count, na_handling handling, const parallel_t& par )
+		{
+			typedef scan_kernel< Policy, Op > kernel;
+			typedef typename kernel::carry_type carry_type;
+
+			const std::size_t blocks = std::min( parallel_threads( par ), std::max( count / scan_grain, std::size_t(1) ) );
+			if( blocks < 2 ) {
+				carry_type carry = kernel::identity();
+				kernel::scan( data, 1, count, 1, &carry, handling );
+				return;
+			}
+
+			std::vector< carry_type > carries( blocks );
+			const parallel_t one_per_block( blocks );
+
+			// pass 1: reduce every block but the last
+			parallel_for( blocks - 1, 1, one_per_block, [&]( std::size_t first, std::size_t last ) {
+				for( std::size_t b = first; b < last; ++b ) {
+					const std::size_t begin = count * b / blocks, end = count * (b + 1) / blocks;
+					carries[b + 1] = kernel::reduce( data + begin, end - begin, handling );
+				}
+			} );
+
+			// exclusive prefix of the block carries
+			carries[0] = kernel::identity();
+			for( std::size_t b = 1; b < blocks; ++b ) {
+				carries[b] = kernel::combine( carries[b - 1], carries[b], handling );
+			}
+
+			// pass 2: scan every block from its carry
+			parallel_for( blocks, 1, one_per_block, [&]( std::size_t first, std::size_t last ) {
+				for( std::size_t b = first; b < last; ++b ) {
+					const std::size_t begin = count * b / blocks, end = count * (b + 1) / blocks;
+					carry_type carry = carries[b];
+					kernel::scan( data + begin, 1, end - begin, 1, &carry, handling );
+				}
+			} );
+		}
+
+		// Major slices are contiguous and independent: one scan each.
+		template< typename Op, typename Array >
+		void scan_slices( Array& arr, tags::major_tag, na_handling handling, const parallel_t& par )
+		{
+			typedef scan_kernel< typename array_policy< Array >::type, Op > kernel;
+			typename Array::value_type* data = arr.data();
+			const std::size_t length = arr.major_size(), stride = arr.stride();
+
+			parallel_for( arr.minor_size(), std::max( scan_grain / std::max( length, std::size_t(1) ), std::size_t(1) ), par,
+				[=]( std::size_t first, std::size_t last ) {
+					for( std::size_t i = first; i < last; ++i ) {
+						typename kernel::carry_type carry = kernel::identity();
+						kernel::scan( data + i * stride, 1, length, 1, &carry, handling );
+					}
+				} );
+		}
+
+		// Minor slices interleave: sweep storage order with one carry per lane,
+		// every thread taking a range of lanes.
+		template< typename Op, typename Array >
+		void scan_slices( Array& arr, tags::minor_tag, na_handling handling, const parallel_t& par )
+		{
+			typedef scan_kernel< typename array_policy< Array >::type, Op > kernel;
+			typename Array::value_type* data = arr.data();
+			const std::size_t length = arr.minor_size(), stride = arr.stride();
+
+			parallel_for( arr.major_size(), std::max( scan_grain / std::max( length, std::size_t(1) ), std::size_t(64) ), par,
+				[=]( std::size_t first, std::size_t last ) {
+					std::vector< typename kernel::carry_type > carry( last - first, kernel::identity() );
+					kernel::scan( data + first, last - first, length, stride, carry.data(), handling );
+				} );
+		}
+
+	}
+
+	// na_vector, in place. The default parallel_t( 1 ) scans serially.
+	template< typename Vector >
+	void cumsum( Vector& vec, na_handling handling = na_skip, const parallel_t& par = parallel_t( 1 ) )
+	{
+		detail::scan_contiguous< typename Vector::policy_type, scan_ops::sum >( vec.data(), vec.size(), handling, par );
+	}
+
+	template< typename Vector >
+	void cumprod( Vector& vec, na_handling handling = na_skip, const parallel_t& par = parallel_t( 1 ) )
+	{
+		detail::scan_contiguous< typename Vector::policy_type, scan_ops::product >( vec.data(), vec.size(), handling, par );
+	}
+
+	template< typename Vector >
+	void cummax( Vector& vec, na_handling handling = na_skip, const parallel_t& par = parallel_t( 1 ) )
+	{
+		detail::scan_contiguous< typename Vector::policy_type, scan_ops::maximum >( vec.data(), vec.size(), handling, par );
+	}
+
+	template< typename Vector >
+	void cummin( Vector& vec, na_handling handling = na_skip, const parallel_t& par = parallel_t( 1 ) )
+	{
+		detail::scan_contiguous< typename Vector::policy_type, scan_ops::minimum >( vec.data(), vec.size(), handling, par );
+	}
+
+	// array2d: *_cols accumulates down every column, *_rows along every row.
+	template< typename Array >
+	void cumsum_cols( Array& arr, na_handling handling = na_skip, const parallel_t& par = parallel_t( 1 ) )
+	{
+		detail::scan_slices< scan_ops::sum >( arr, typename Array::column_tag(), handling, par );
+	}
+
+	template< typename Array >
+	void cumsum_rows( Array& arr, na_handling handling = na_skip, const parallel_t& par = parallel_t( 1 ) )
+	{
+		detail::scan_slices< scan_ops::sum >( arr, typename Array::row_tag(), handling, par );
+	}
+
+	template< typename Array >
+	void cumprod_cols( Array& arr, na_handling handling = na_skip, const parallel_t& par = parallel_t( 1 ) )
+	{
+		detail::scan_slices< scan_ops::product >( arr, typename Array::column_tag(), handling, par );
+	}
+
+	template< typename Array >
+	void cumprod_rows( Array& arr, na_handling handling = na_skip, const parallel_t& par = parallel_t( 1 ) )
+	{
+		detail::scan_slices< scan_ops::product >( arr, typename Array::row_tag(), handling, par );
+	}
+
+	template< typename Array >
+	void cummax_cols( Array& arr, na_handling handling = na_skip, const parallel_t& par = parallel_t( 1 ) )
+	{
+		detail::scan_slices< scan_ops::maximum >( arr, typename Array::column_tag(), handling, par );
+	}
+
+	template< typename Array >
+	void cummax_rows( Array& arr, na_handling handling = na_skip, const parallel_t& par = parallel_t( 1 ) )
+	{
+		detail::scan_slices< scan_ops::maximum >( arr, typename Array::row_tag(), handling, par );
+	}
+
+	template< typename Array >
+	void cummin_cols( Array& arr, na_handling handling = na_skip, const parallel_t& par = parallel_t( 1 ) )
+	{
+		detail::scan_slices< scan_ops::minimum >( arr, typename Array::column_tag(), handling, par );
+	}
+
+	template< typename Array >
+	void cummin_rows( Array& arr, na_handling handling = na_skip, const parallel_t& par = parallel_t( 1 ) )
+	{
+		detail::scan_slices< scan_ops::minimum >( arr, typename Array::row_tag(), handling, par );
+	}
+
+}
@@ -0,0 +1,439 @@
+#pragma once
+#include <na_containers/na_vector.h>
+#include <boost/iterator/iterator_facade.hpp>
+#include <memory>
+#include <vector>
+
+namespace na {
+
+	namespace detail {
+
+		template< typename Vector, typename ValueType >
+		class segmented_iterator
+			: public boost::iterator_facade< segmented_iterator< Vector, ValueType >,
+											 ValueType,
+											 std::random_access_iterator_tag >
+		{
+		public:
+			typedef typename segmented_iterator::iterator_facade_::reference reference;
+			typedef typename segmented_iterator::iterator_facade_::difference_type difference_type;
+
+			segmented_iterator()
+				: chunks_( nullptr ), index_( 0 )
+			{
+			}
+
+			segmented_iterator( ValueType* const* chunks, std::size_t index )
+				: chunks_( chunks ), index_( index )
+			{
+			}
+
+			operator segmented_iterator< Vector, const ValueType >() const
+			{
+				return segmented_iterator< Vector, const ValueType >( chunks_, index_ );
+			}
+
+			reference dereference() const
+			{
+				return chunks_[ index_ / Vector::chunk_size ][ index_ % Vector::chunk_size ];
+			}
+
+			void increment()
+			{
+				++index_;
+			}
+
+			void decrement()
+			{
+				--index_;
+			}
+
+			bool equal( const segmented_iterator& other ) const
+			{
+				return index_ == other.index_;
+			}
+
+			difference_type distance_to( const segmented_iterator& other ) const
+			{
+				return difference_type(other.index_) - difference_type(index_);
+			}
+
+			void advance( difference_type diff )
+			{
+				index_ += diff;
+			}
+
+		private:
+			ValueType* const* chunks_;
+			std::size_t index_;
+		};
+
+	}
+
+	// na_vector look-alike that stores its elements in fixed-size chunks
+	// instead of one contiguous buffer. Growing allocates a new chunk and never
+	// moves existing elements, so references and pointers stay valid across
+	// push_back and there is no reallocation spike. Only the table of chunk
+	// pointers is ever reallocated.
+	//
+	// Element access costs a shift and a mask; bulk work should go through
+	// for_each_chunk, which hands out every chunk as a contiguous range.
+	// The container is append-oriented: there is no insert or erase.
+	template< typename ValueType, class NaPolicy = policies::NaPolicySV< ValueType >,
+			  std::size_t ChunkSize = 8192, typename Allocator = std::allocator< ValueType > >
+	class na_segmented_vector : private NaPolicy {
+		static_assert( ChunkSize != 0 && (ChunkSize & (ChunkSize - 1)) == 0, "ChunkSize must be a power of two" );
+
+	public:
+		typedef NaPolicy policy_type;
+		typedef typename NaPolicy::value_type value_type;
+
+		typedef value_type& reference;
+		typedef const value_type& const_reference;
+
+		typedef typename Allocator::template rebind< value_type >::other allocator_type;
+		typedef std::size_t size_type;
+		typedef std::ptrdiff_t difference_type;
+
+		typedef detail::segmented_iterator< na_segmented_vector, value_type > iterator;
+		typedef detail::segmented_iterator< na_segmented_vector, const value_type > const_iterator;
+
+		typedef std::reverse_iterator< iterator > reverse_iterator;
+		typedef std::reverse_iterator< const_iterator > const_reverse_iterator;
+
+		typedef detail::filtered_list< iterator, NaPolicy > filtered_list;
+
+		static const size_type chunk_size = ChunkSize;
+
+	public:
+		static value_type get_na() {
+			return NaPolicy::get_na();
+		}
+
+		filtered_list filtered()
+		{
+			iterator first = begin(), last = end();
+			return filtered_list( first, last );
+		}
+
+	public:
+		explicit na_segmented_vector( const allocator_type& alloc = allocator_type() )
+			: alloc_( alloc ), size_( 0 )
+		{
+		}
+
+		explicit na_segmented_vector( size_type n )
+			: size_( 0 )
+		{
+			resize( n );
+		}
+
+		na_segmented_vector( size_type n, const value_type& val,
+			const allocator_type& alloc = allocator_type() )
+			: alloc_( alloc ), size_( 0 )
+		{
+			resize( n, val );
+		}
+
+		template< class InputIterator >
+		na_segmented_vector( InputIterator first, InputIterator last,
+			const allocator_type& alloc = allocator_type() )
+			: alloc_( alloc ), size_( 0 )
+		{
+			append( first, last );
+		}
+
+		na_segmented_vector( const na_segmented_vector& x )
+			: alloc_( x.alloc_ ), size_( 0 )
+		{
+			reserve( x.size() );
+			x.for_each_chunk( append_range( *this ) );
+		}
+
+		na_segmented_vector( na_segmented_vector&& x )
+			: alloc_( x.alloc_ ), size_( 0 )
+		{
+			swap( x );
+		}
+
+		~na_segmented_vector()
+		{
+			clear();
+			shrink_to_fit();
+		}
+
+		na_segmented_vector& operator=( const na_segmented_vector& x )
+		{
+			if( this != &x ) {
+				na_segmented_vector tmp( x );
+				swap( tmp );
+			}
+			return *this;
+		}
+
+		na_segmented_vector& operator=( na_segmented_vector&& x )
+		{
+			swap( x );
+			return *this;
+		}
+
+	public:
+		iterator begin() {
+			return iterator( chunks_.data(), 0 );
+		}
+
+		iterator end() {
+			return iterator( chunks_.data(), size_ );
+		}
+
+		const_iterator begin() const {
+			return const_iterator( chunks_.data(), 0 );
+		}
+
+		const_iterator end() const {
+			return const_iterator( chunks_.data(), size_ );
+		}
+
+		const_iterator cbegin() const {
+			return begin();
+		}
+
+		const_iterator cend() const {
+			return end();
+		}
+
+		reverse_iterator rbegin() {
+			return reverse_iterator( end() );
+		}
+
+		reverse_iterator rend() {
+			return reverse_iterator( begin() );
+		}
+
+		const_reverse_iterator rbegin() const {
+			return const_reverse_iterator( end() );
+		}
+
+		const_reverse_iterator rend() const {
+			return const_reverse_iterator( begin() );
+		}
+
+		const_reverse_iterator crbegin() const {
+			return rbegin();
+		}
+
+		const_reverse_iterator crend() const {
+			return rend();
+		}
+
+		const_reference operator[]( size_type index ) const
+		{
+			return chunks_[ index / chunk_size ][ index % chunk_size ];
+		}
+
+		reference operator[]( size_type index )
+		{
+			return chunks_[ index / chunk_size ][ index % chunk_size ];
+		}
+
+		void push_back( const_reference val )
+		{
+			if( size_ == chunks_.size() * chunk_size ) {
+				_add_chunk();
+			}
+			alloc_.construct( &(*this)[size_], val );
+			++size_;
+		}
+
+		void push_back( detail::_na_type ) {
+			push_back( get_na() );
+		}
+
+		void pop_back()
+		{
+			--size_;
+			alloc_.destroy( &(*this)[size_] );
+		}
+
+		template< class InputIterator >
+		void append( InputIterator first, InputIterator last )
+		{
+			for( ; first != last; ++first ) {
+				push_back( *first );
+			}
+		}
+
+		// swap
+	public:
+		void swap( na_segmented_vector& x )
+		{
+			std::swap( alloc_, x.alloc_ );
+			chunks_.swap( x.chunks_ );
+			std::swap( size_, x.size_ );
+		}
+
+		size_type size() const
+		{
+			return size_;
+		}
+
+		size_type max_size() const noexcept
+		{
+			return alloc_.max_size();
+		}
+
+		// resize
+	public:
+		void resize( size_type n )
+		{
+			resize( n, get_na() );
+		}
+
+		void resize( size_type n, const detail::_na_type& )
+		{
+			resize( n, get_na() );
+		}
+
+		void resize( size_type n, const value_type& val )
+		{
+			while( size_ > n ) {
+				pop_back();
+			}
+			reserve( n );
+			while( size_ < n ) {
+				push_back( val );
+			}
+		}
+
+		void reserve( size_type n )
+		{
+			while( capacity() < n ) {
+				_add_chunk();
+			}
+		}
+
+		// Releases the chunks past the one holding the last element.
+		void shrink_to_fit()
+		{
+			const size_type used = (size_ + chunk_size - 1) / chunk_size;
+			while( chunks_.size() > used ) {
+				alloc_.deallocate( chunks_.back(), chunk_size );
+				chunks_.pop_back();
+			}
+			chunks_.shrink_to_fit();
+		}
+
+		bool empty() const
+		{
+			return size_ == 0;
+		}
+
+		void clear() noexcept
+		{
+			while( size_ ) {
+				pop_back();
+			}
+		}
+
+		size_type capacity() const noexcept
+		{
+			return chunks_.size() * chunk_size;
+		}
+
+		// chunk access
+	public:
+		size_type chunk_count() const
+		{
+			return (size_ + chunk_size - 1) / chunk_size;
+		}
+
+		value_type* chunk_data( size_type chunk )
+		{
+			return chunks_[chunk];
+		}
+
+		const value_type* chunk_data( size_type chunk ) const
+		{
+			return chunks_[chunk];
+		}
+
+		// number of elements in use in the given chunk
+		size_type chunk_length( size_type chunk ) const
+		{
+			return std::min( chunk_size, size_ - chunk * chunk_size );
+		}
+
+		// Calls f( first, last ) once per chunk with the chunk's elements as a
+		// contiguous pointer range, in order.
+		template< typename Function >
+		Function for_each_chunk( Function f )
+		{
+			for( size_type i = 0, count = chunk_count(); i < count; ++i ) {
+				f( chunks_[i], chunks_[i] + chunk_length( i ) );
+			}
+			return f;
+		}
+
+		template< typename Function >
+		Function for_each_chunk( Function f ) const
+		{
+			for( size_type i = 0, count = chunk_count(); i < count; ++i ) {
+				f( static_cast< const value_type* >( chunks_[i] ), static_cast< const value_type* >( chunks_[i] ) + chunk_length( i ) );
+			}
+			return f;
+		}
+
+		size_type count_na() const
+		{
+			count_na_range counter;
+			return for_each_chunk( counter ).count;
+		}
+
+	private:
+		struct append_range {
+			explicit append_range( na_segmented_vector& target )
+				: target_( &target )
+			{
+			}
+
+			void operator()( const value_type* first, const value_type* last )
+			{
+				target_->append( first, last );
+			}
+
+			na_segmented_vector* target_;
+		};
+
+		struct count_na_range {
+			count_na_range()
+				: count( 0 )
+			{
+			}
+
+			void operator()( const value_type* first, const value_type* last )
+			{
+				size_type result = 0;
+				for( ; first != last; ++first ) {
+					result += NaPolicy::is_na( *first ) ? 1 : 0;
+				}
+				count += result;
+			}
+
+			size_type count;
+		};
+
+		void _add_chunk()
+		{
+			chunks_.push_back( alloc_.allocate( chunk_size ) );
+		}
+
+		allocator_type alloc_;
+		std::vector< value_type* > chunks_;
+		size_type size_;
+	};
+
+	template< typename ValueType, class NaPolicy, std::size_t ChunkSize, typename Allocator >
+	const typename na_segmented_vector< ValueType, NaPolicy, ChunkSize, Allocator >::size_type
+		na_segmented_vector< ValueType, NaPolicy, ChunkSize, Allocator >::chunk_size;
+
+}
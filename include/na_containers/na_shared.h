@@ -0,0 +1,596 @@
+#pragma once
+#include <na_containers/na_vector.h>
+#include <na_containers/array2d.h>
+#include <boost/cstdint.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+
+// na_vector and array2d storage in a named shared-memory segment (POSIX
+// shm_open on Linux, boost::interprocess emulation elsewhere), so that one
+// producer process fills a matrix and any number of reader processes map the
+// same pages instead of keeping their own copy.
+//
+// The segment is self-describing: a fixed header (sizes, capacities, order,
+// element size and NA policy) followed by the payload at a 64 byte aligned
+// offset, laid out exactly as in array2d. Nothing in the segment is a
+// pointer, so every process may map it at a different address. open()
+// checks the header against the requested type and throws
+// std::invalid_argument on a mismatch.
+//
+//   producer:  auto m = na::shared_array2d< double >::create( "ref", src );
+//   reader:    const auto m = na::shared_array2d< double >::open( "ref" );
+//
+// Capacity is fixed at creation; the producer may resize within it, and
+// readers see the new sizes on their next call (growth is NA filled before
+// it is published). Values are copied bytewise, so the value type has to be
+// trivially copyable, and all processes have to be built from the same
+// sources: the NA policy is identified by its type name.
+//
+// The segment lives until remove( name ); existing mappings stay valid after
+// that on POSIX systems.
+
+namespace na {
+
+	enum shared_access {
+		shared_read_only,
+		shared_read_write
+	};
+
+	namespace detail {
+
+		const boost::uint32_t shared_magic   = 0x4E415348;	// "NASH"
+		const boost::uint32_t shared_version = 1;
+		const std::size_t shared_payload_alignment = 64;
+
+		enum shared_kind {
+			shared_kind_vector = 1,
+			shared_kind_array  = 2
+		};
+
+		// A vector is stored as one major slice of major_max_ elements.
+		struct shared_header {
+			std::atomic< boost::uint32_t > magic;	// written last by the producer
+			boost::uint32_t version;
+			boost::uint32_t kind;
+			boost::uint32_t row_major;
+			boost::uint64_t value_size;
+			boost::uint64_t policy_id;
+			boost::uint64_t major_max_;
+			boost::uint64_t minor_max_;
+			std::atomic< boost::uint64_t > major_size_;
+			std::atomic< boost::uint64_t > minor_size_;
+			boost::uint64_t payload_offset;
+		};
+
+		// FNV-1a of the policy's type name.
+		template< typename NaPolicy >
+		boost::uint64_t shared_policy_id()
+		{
+			boost::uint64_t hash = 14695981039346656037ULL;
+			for( const char* p = typeid( NaPolicy ).name(); *p; ++p ) {
+				hash = (hash ^ static_cast< unsigned char >( *p )) * 1099511628211ULL;
+			}
+			return hash;
+		}
+
+		inline std::size_t shared_payload_offset()
+		{
+			return (sizeof( shared_header ) + shared_payload_alignment - 1) / shared_payload_alignment * shared_payload_alignment;
+		}
+
+		// Owns the mapping of one segment and its header.
+		class shared_segment {
+		public:
+			shared_segment()
+				: header_( nullptr )
+			{
+			}
+
+			shared_segment( shared_segment&& other )
+				: name_( std::move( other.name_ ) ), region_( std::move( other.region_ ) ),
+				  header_( other.header_ )
+			{
+				other.header_ = nullptr;
+			}
+
+			shared_segment& operator=( shared_segment&& other )
+			{
+				name_ = std::move( other.name_ );
+				region_ = std::move( other.region_ );
+				header_ = other.header_;
+				other.header_ = nullptr;
+				return *this;
+			}
+
+			// Creates the segment (failing if the name exists) with an
+			// unpublished header; publish() makes it visible to open().
+			void create( const char* name, shared_kind kind, bool row_major, std::size_t value_size,
+						 boost::uint64_t policy_id, std::size_t major_max, std::size_t minor_max )
+			{
+				namespace ipc = boost::interprocess;
+
+				if( minor_max && major_max > (std::numeric_limits< std::size_t >::max)() / value_size / minor_max ) {
+					throw std::length_error( "na::shared_segment: capacity too large" );
+				}
+				const std::size_t bytes = shared_payload_offset() + major_max * minor_max * value_size;
+
+				ipc::shared_memory_object shm( ipc::create_only, name, ipc::read_write );
+				try {
+					shm.truncate( static_cast< ipc::offset_t >( bytes ) );
+					ipc::mapped_region region( shm, ipc::read_write, 0, bytes );
+					region_.swap( region );
+				} catch( ... ) {
+					ipc::shared_memory_object::remove( name );
+					throw;
+				}
+
+				name_ = name;
+				header_ = new( region_.get_address() ) shared_header;
+				header_->magic.store( 0, std::memory_order_relaxed );
+				header_->version = shared_version;
+				header_->kind = kind;
+				header_->row_major = row_major ? 1 : 0;
+				header_->value_size = value_size;
+				header_->policy_id = policy_id;
+				header_->major_max_ = major_max;
+				header_->minor_max_ = minor_max;
+				header_->major_size_.store( 0, std::memory_order_relaxed );
+				header_->minor_size_.store( 0, std::memory_order_relaxed );
+				header_->payload_offset = shared_payload_offset();
+			}
+
+			void publish()
+			{
+				header_->magic.store( shared_magic, std::memory_order_release );
+			}
+
+			void open( const char* name, shared_kind kind, bool row_major, std::size_t value_size,
+					   boost::uint64_t policy_id, shared_access access )
+			{
+				namespace ipc = boost::interprocess;
+				const ipc::mode_t mode = access == shared_read_write ? ipc::read_write : ipc::read_only;
+
+				ipc::shared_memory_object shm( ipc::open_only, name, mode );
+				ipc::mapped_region region( shm, mode );
+				if( region.get_size() < sizeof( shared_header ) ) {
+					throw std::invalid_argument( "na::shared_segment: segment too small for a header" );
+				}
+
+				shared_header* header = static_cast< shared_header* >( region.get_address() );
+				if( header->magic.load( std::memory_order_acquire ) != shared_magic ) {
+					throw std::invalid_argument( "na::shared_segment: not an initialized na_containers segment" );
+				}
+				if( header->version != shared_version ) {
+					throw std::invalid_argument( "na::shared_segment: segment version differs" );
+				}
+				if( header->kind != boost::uint32_t( kind ) ) {
+					throw std::invalid_argument( "na::shared_segment: segment holds another container kind" );
+				}
+				if( header->row_major != (row_major ? 1u : 0u) ) {
+					throw std::invalid_argument( "na::shared_segment: segment holds another order" );
+				}
+				if( header->value_size != value_size ) {
+					throw std::invalid_argument( "na::shared_segment: segment holds another value type" );
+				}
+				if( header->policy_id != policy_id ) {
+					throw std::invalid_argument( "na::shared_segment: segment holds another NA policy" );
+				}
+				if( region.get_size() < header->payload_offset + header->major_max_ * header->minor_max_ * value_size ) {
+					throw std::invalid_argument( "na::shared_segment: segment smaller than its capacity" );
+				}
+
+				region_.swap( region );
+				name_ = name;
+				header_ = header;
+			}
+
+			shared_header& header() const
+			{
+				return *header_;
+			}
+
+			void* payload() const
+			{
+				return static_cast< char* >( region_.get_address() ) + header_->payload_offset;
+			}
+
+			const std::string& name() const
+			{
+				return name_;
+			}
+
+		private:
+			shared_segment( const shared_segment& );
+			shared_segment& operator=( const shared_segment& );
+
+			std::string name_;
+			boost::interprocess::mapped_region region_;
+			shared_header* header_;
+		};
+
+	}
+
+	// Removes the segment's name; mapped processes keep their pages.
+	inline bool remove_shared( const char* name )
+	{
+		return boost::interprocess::shared_memory_object::remove( name );
+	}
+
+	// na_vector of fixed capacity in shared memory. Offers the contiguous
+	// interface of na_vector (data(), size(), operator[], policy_type) so
+	// the vector algorithms run on it directly.
+	template< typename ValueType, typename NaPolicy = policies::NaPolicySV< ValueType > >
+	class shared_vector {
+	public:
+		typedef NaPolicy policy_type;
+		typedef typename NaPolicy::value_type value_type;
+		typedef value_type& reference;
+		typedef const value_type& const_reference;
+		typedef value_type* iterator;
+		typedef const value_type* const_iterator;
+		typedef std::size_t size_type;
+
+		shared_vector( shared_vector&& other )
+			: segment_( std::move( other.segment_ ) )
+		{
+		}
+
+		shared_vector& operator=( shared_vector&& other )
+		{
+			segment_ = std::move( other.segment_ );
+			return *this;
+		}
+
+		// New segment of `capacity` elements, initially empty.
+		static shared_vector create( const char* name, size_type capacity )
+		{
+			shared_vector result;
+			result.segment_.create( name, detail::shared_kind_vector, false, sizeof( value_type ),
+									detail::shared_policy_id< NaPolicy >(), capacity, 1 );
+			result.segment_.publish();
+			return result;
+		}
+
+		// New segment holding a copy of vec, with room for `capacity`
+		// elements (at least vec.size()). Disabled for integral arguments, so
+		// that create( name, 4 ) picks the capacity overload.
+		template< typename Vector >
+		static typename std::enable_if< !std::is_integral< Vector >::value, shared_vector >::type
+		create( const char* name, const Vector& vec, size_type capacity = 0 )
+		{
+			static_assert( std::is_same< typename Vector::policy_type, NaPolicy >::value, "shared_vector::create needs a vector of the same NA policy" );
+
+			shared_vector result;
+			result.segment_.create( name, detail::shared_kind_vector, false, sizeof( value_type ),
+									detail::shared_policy_id< NaPolicy >(), std::max( capacity, vec.size() ), 1 );
+			std::copy( vec.data(), vec.data() + vec.size(), result._payload() );
+			result.segment_.header().major_size_.store( vec.size(), std::memory_order_relaxed );
+			result.segment_.publish();
+			return result;
+		}
+
+		static shared_vector open( const char* name, shared_access access = shared_read_only )
+		{
+			shared_vector result;
+			result.segment_.open( name, detail::shared_kind_vector, false, sizeof( value_type ),
+								  detail::shared_policy_id< NaPolicy >(), access );
+			return result;
+		}
+
+		static value_type get_na()
+		{
+			return NaPolicy::get_na();
+		}
+
+		size_type size() const
+		{
+			return static_cast< size_type >( segment_.header().major_size_.load( std::memory_order_acquire ) );
+		}
+
+		size_type capacity() const
+		{
+			return static_cast< size_type >( segment_.header().major_max_ );
+		}
+
+		bool empty() const
+		{
+			return size() == 0;
+		}
+
+		value_type* data()
+		{
+			return _payload();
+		}
+
+		const value_type* data() const
+		{
+			return _payload();
+		}
+
+		iterator begin() { return data(); }
+		iterator end() { return data() + size(); }
+		const_iterator begin() const { return data(); }
+		const_iterator end() const { return data() + size(); }
+
+		reference operator[]( size_type i )
+		{
+			return _payload()[i];
+		}
+
+		const_reference operator[]( size_type i ) const
+		{
+			return _payload()[i];
+		}
+
+		bool is_na( size_type i ) const
+		{
+			return NaPolicy::is_na( _payload()[i] );
+		}
+
+		// Producer side. The element is written before the new size is
+		// published, so a reader never sees an unwritten element.
+		void push_back( const value_type& val )
+		{
+			const size_type n = size();
+			if( n == capacity() ) {
+				throw std::length_error( "na::shared_vector: capacity exhausted" );
+			}
+			_payload()[n] = val;
+			segment_.header().major_size_.store( n + 1, std::memory_order_release );
+		}
+
+		// Grows with NA or shrinks within the capacity.
+		void resize( size_type n )
+		{
+			if( n > capacity() ) {
+				throw std::length_error( "na::shared_vector: resize beyond capacity" );
+			}
+			const size_type old = size();
+			if( n > old ) {
+				std::fill( _payload() + old, _payload() + n, NaPolicy::get_na() );
+			}
+			segment_.header().major_size_.store( n, std::memory_order_release );
+		}
+
+		const std::string& name() const
+		{
+			return segment_.name();
+		}
+
+	private:
+		shared_vector()
+		{
+		}
+
+		shared_vector( const shared_vector& );
+		shared_vector& operator=( const shared_vector& );
+
+		value_type* _payload() const
+		{
+			return static_cast< value_type* >( segment_.payload() );
+		}
+
+		detail::shared_segment segment_;
+	};
+
+	// array2d in shared memory, with array2d's storage layout: minor_max_
+	// major slices of major_max_ elements, the first major_size_ of each in
+	// use. Offers dereference, data() and the layout accessors, so the
+	// array algorithms (stats, fill, scans, sketches) run on it directly.
+	template< typename ValueType, typename OrderType = order::column_major,
+			  typename NaPolicy = policies::NaPolicySV< ValueType > >
+	class shared_array2d {
+		static const bool is_row_major = std::is_same< OrderType, order::row_major >::value;
+
+	public:
+		typedef NaPolicy policy_type;
+		typedef typename NaPolicy::value_type value_type;
+		typedef value_type& reference;
+		typedef const value_type& const_reference;
+		typedef std::size_t size_type;
+		typedef OrderType order_type;
+		typedef typename ::detail::array2d_order< OrderType >::row_tag row_tag;
+		typedef typename ::detail::array2d_order< OrderType >::column_tag column_tag;
+
+		shared_array2d( shared_array2d&& other )
+			: segment_( std::move( other.segment_ ) )
+		{
+		}
+
+		shared_array2d& operator=( shared_array2d&& other )
+		{
+			segment_ = std::move( other.segment_ );
+			return *this;
+		}
+
+		// New segment of rows x cols NA elements, with room to grow to
+		// max_rows x max_cols.
+		static shared_array2d create( const char* name, size_type rows, size_type cols, size_type max_rows = 0, size_type max_cols = 0 )
+		{
+			max_rows = std::max( max_rows, rows );
+			max_cols = std::max( max_cols, cols );
+
+			shared_array2d result;
+			result.segment_.create( name, detail::shared_kind_array, is_row_major, sizeof( value_type ), detail::shared_policy_id< NaPolicy >(),
+									is_row_major ? max_cols : max_rows, is_row_major ? max_rows : max_cols );
+			detail::shared_header& header = result.segment_.header();
+			std::fill( result._payload(), result._payload() + header.major_max_ * header.minor_max_, NaPolicy::get_na() );
+			result._set_sizes( rows, cols );
+			result.segment_.publish();
+			return result;
+		}
+
+		// New segment holding a copy of arr (an array2d or array2d_fixed of
+		// the same order and NA policy), copied slice by slice.
+		template< typename Array >
+		static shared_array2d create( const char* name, const Array& arr )
+		{
+			static_assert( std::is_same< typename Array::order_type, OrderType >::value, "shared_array2d::create needs an array of the same order" );
+			static_assert( std::is_same< typename detail::array_policy< Array >::type, NaPolicy >::value, "shared_array2d::create needs an array of the same NA policy" );
+
+			shared_array2d result;
+			result.segment_.create( name, detail::shared_kind_array, is_row_major, sizeof( value_type ), detail::shared_policy_id< NaPolicy >(),
+									arr.major_size(), arr.minor_size() );
+			for( size_type i = 0; i < arr.minor_size(); ++i ) {
+				std::copy( arr.data() + i * arr.stride(), arr.data() + i * arr.stride() + arr.major_size(), result._payload() + i * arr.major_size() );
+			}
+			result._set_sizes( arr.rows(), arr.cols() );
+			result.segment_.publish();
+			return result;
+		}
+
+		static shared_array2d open( const char* name, shared_access access = shared_read_only )
+		{
+			shared_array2d result;
+			result.segment_.open( name, detail::shared_kind_array, is_row_major, sizeof( value_type ),
+								  detail::shared_policy_id< NaPolicy >(), access );
+			return result;
+		}
+
+		static value_type get_na()
+		{
+			return NaPolicy::get_na();
+		}
+
+		size_type rows() const
+		{
+			return is_row_major ? minor_size() : major_size();
+		}
+
+		size_type cols() const
+		{
+			return is_row_major ? major_size() : minor_size();
+		}
+
+		size_type max_rows() const
+		{
+			return static_cast< size_type >( is_row_major ? segment_.header().minor_max_ : segment_.header().major_max_ );
+		}
+
+		size_type max_cols() const
+		{
+			return static_cast< size_type >( is_row_major ? segment_.header().major_max_ : segment_.header().minor_max_ );
+		}
+
+		size_type to_index( size_type row, size_type col ) const
+		{
+			return is_row_major ? row * stride() + col : col * stride() + row;
+		}
+
+		reference dereference( size_type row, size_type col )
+		{
+			return _payload()[ to_index( row, col ) ];
+		}
+
+		const_reference dereference( size_type row, size_type col ) const
+		{
+			return _payload()[ to_index( row, col ) ];
+		}
+
+		value_type* data()
+		{
+			return _payload();
+		}
+
+		const value_type* data() const
+		{
+			return _payload();
+		}
+
+		// Storage layout, as for array2d.
+		size_type major_size() const
+		{
+			return static_cast< size_type >( segment_.header().major_size_.load( std::memory_order_acquire ) );
+		}
+
+		size_type minor_size() const
+		{
+			return static_cast< size_type >( segment_.header().minor_size_.load( std::memory_order_acquire ) );
+		}
+
+		size_type stride() const
+		{
+			return static_cast< size_type >( segment_.header().major_max_ );
+		}
+
+		static size_type major_alignment()
+		{
+			return 1;
+		}
+
+		// Producer side: changes the visible size within the capacity. The
+		// stride is fixed, so no element moves; elements leaving the visible
+		// area are reset to NA, and so are NA again when they come back.
+		void resize( size_type rows, size_type cols )
+		{
+			if( rows > max_rows() || cols > max_cols() ) {
+				throw std::length_error( "na::shared_array2d: resize beyond capacity" );
+			}
+			const size_type major = is_row_major ? cols : rows;
+			const size_type minor = is_row_major ? rows : cols;
+			const size_type old_major = major_size(), old_minor = minor_size();
+			const value_type na = NaPolicy::get_na();
+
+			// shrink first, so readers never index past what they were told
+			_set_sizes_major_minor( std::min( major, old_major ), std::min( minor, old_minor ) );
+			for( size_type i = 0; i < old_minor; ++i ) {
+				value_type* slice = _payload() + i * stride();
+				if( i >= minor ) {
+					std::fill( slice, slice + old_major, na );
+				} else if( major < old_major ) {
+					std::fill( slice + major, slice + old_major, na );
+				}
+			}
+			_set_sizes_major_minor( major, minor );
+		}
+
+		const std::string& name() const
+		{
+			return segment_.name();
+		}
+
+	private:
+		shared_array2d()
+		{
+		}
+
+		shared_array2d( const shared_array2d& );
+		shared_array2d& operator=( const shared_array2d& );
+
+		value_type* _payload() const
+		{
+			return static_cast< value_type* >( segment_.payload() );
+		}
+
+		void _set_sizes( size_type rows, size_type cols )
+		{
+			_set_sizes_major_minor( is_row_major ? cols : rows, is_row_major ? rows : cols );
+		}
+
+		void _set_sizes_major_minor( size_type major, size_type minor )
+		{
+			segment_.header().major_size_.store( major, std::memory_order_release );
+			segment_.header().minor_size_.store( minor, std::memory_order_release );
+		}
+
+		detail::shared_segment segment_;
+	};
+
+	namespace detail {
+
+		template< typename ValueType, typename OrderType, typename NaPolicy >
+		struct array_policy< shared_array2d< ValueType, OrderType, NaPolicy > > {
+			typedef NaPolicy type;
+		};
+
+	}
+
+}
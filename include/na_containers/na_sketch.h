@@ -0,0 +1,463 @@
+#pragma once
+#include <na_containers/na_vector.h>
+#include <na_containers/array2d.h>
+#include <na_containers/parallel.h>
+#include <boost/cstdint.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Mergeable streaming summaries of the non-NA values of a vector or of the
+// slices of an array.
+//
+//   histogram   - fixed bins over [lo, hi), plus underflow and overflow
+//   kll_sketch  - quantile sketch after Karnin, Lang and Liberty (2016)
+//
+// Both take values one at a time with add(), count NAs with add_na(), and
+// combine with merge(), so per-thread or per-partition sketches can be
+// built independently and merged into one. sketch() builds one from a
+// vector, optionally in parallel; column_sketches() and row_sketches() build
+// one per slice of an array in a single pass over its storage.
+
+namespace na {
+
+	class histogram {
+	public:
+		histogram( double lo, double hi, std::size_t bins )
+			: lo_( lo ), hi_( hi ), scale_( bins / (hi - lo) ), counts_( bins, 0 ),
+			  underflow_( 0 ), overflow_( 0 ), na_count_( 0 ), nan_count_( 0 )
+		{
+			if( !(hi > lo) || bins == 0 ) {
+				throw std::invalid_argument( "na::histogram: need lo < hi and at least one bin" );
+			}
+		}
+
+		// A NaN that is not NA (NaPolicyNaN keeps those as values) has no bin
+		// and is only counted.
+		void add( double value )
+		{
+			if( value != value ) {
+				++nan_count_;
+			} else if( value < lo_ ) {
+				++underflow_;
+			} else if( value >= hi_ ) {
+				++overflow_;
+			} else {
+				// rounding can put values just below hi past the last bin
+				++counts_[ std::min( std::size_t( (value - lo_) * scale_ ), counts_.size() - 1 ) ];
+			}
+		}
+
+		void add_na()
+		{
+			++na_count_;
+		}
+
+		// Both histograms need the same bins.
+		void merge( const histogram& other )
+		{
+			if( other.lo_ != lo_ || other.hi_ != hi_ || other.counts_.size() != counts_.size() ) {
+				throw std::invalid_argument( "na::histogram: merging histograms with different bins" );
+			}
+			for( std::size_t i = 0; i < counts_.size(); ++i ) {
+				counts_[i] += other.counts_[i];
+			}
+			underflow_ += other.underflow_;
+			overflow_  += other.overflow_;
+			na_count_  += other.na_count_;
+			nan_count_ += other.nan_count_;
+		}
+
+		std::size_t bins() const
+		{
+			return counts_.size();
+		}
+
+		double bin_width() const
+		{
+			return (hi_ - lo_) / counts_.size();
+		}
+
+		double bin_lower( std::size_t bin ) const
+		{
+			return lo_ + bin * bin_width();
+		}
+
+		boost::uint64_t count( std::size_t bin ) const
+		{
+			return counts_[bin];
+		}
+
+		boost::uint64_t underflow() const
+		{
+			return underflow_;
+		}
+
+		boost::uint64_t overflow() const
+		{
+			return overflow_;
+		}
+
+		boost::uint64_t na_count() const
+		{
+			return na_count_;
+		}
+
+		boost::uint64_t nan_count() const
+		{
+			return nan_count_;
+		}
+
+		// Non-NA, non-NaN values, including under- and overflow.
+		boost::uint64_t total() const
+		{
+			boost::uint64_t result = underflow_ + overflow_;
+			for( std::size_t i = 0; i < counts_.size(); ++i ) {
+				result += counts_[i];
+			}
+			return result;
+		}
+
+		// Value below which a fraction q of the values lie, interpolated
+		// linearly inside the bin; off by at most one bin width as long as
+		// the quantile is not in the under- or overflow (then lo or hi).
+		double quantile( double q ) const
+		{
+			const double target = q * double( total() );
+			double seen = double( underflow_ );
+			if( target <= seen ) {
+				return lo_;
+			}
+			for( std::size_t i = 0; i < counts_.size(); ++i ) {
+				if( seen + counts_[i] >= target && counts_[i] ) {
+					return bin_lower( i ) + bin_width() * (target - seen) / counts_[i];
+				}
+				seen += counts_[i];
+			}
+			return hi_;
+		}
+
+	private:
+		double lo_, hi_, scale_;
+		std::vector< boost::uint64_t > counts_;
+		boost::uint64_t underflow_, overflow_, na_count_, nan_count_;
+	};
+
+	// KLL quantile sketch: a stack of compactors, level h holding items of
+	// weight 2^h. A full level is sorted and every other item (starting at a
+	// random one of the first two) moves up a level. Space is O(k); the rank
+	// of a returned quantile is off by at most about 3.3/k of the count (k =
+	// 200: 1.65%) with 99% probability, independent of the number of values.
+	class kll_sketch {
+	public:
+		explicit kll_sketch( std::size_t k = 200 )
+			: k_( std::max( k, std::size_t(8) ) ), count_( 0 ), na_count_( 0 ), nan_count_( 0 ),
+			  min_( std::numeric_limits< double >::quiet_NaN() ), max_( min_ ),
+			  random_( 0x9E3779B97F4A7C15ull ), retained_( 0 ), levels_( 1 )
+		{
+			_update_capacities();
+		}
+
+		// A NaN that is not NA is only counted: it has no rank.
+		void add( double value )
+		{
+			if( value != value ) {
+				++nan_count_;
+				return;
+			}
+			min_ = count_ == 0 || value < min_ ? value : min_;
+			max_ = count_ == 0 || value > max_ ? value : max_;
+			++count_;
+			levels_[0].push_back( value );
+			if( ++retained_ >= total_capacity_ ) {
+				_compress();
+			}
+		}
+
+		void add_na()
+		{
+			++na_count_;
+		}
+
+		// Sketches of any k merge; the result keeps this one's k.
+		void merge( const kll_sketch& other )
+		{
+			na_count_  += other.na_count_;
+			nan_count_ += other.nan_count_;
+			if( other.count_ == 0 ) {
+				return;
+			}
+			min_ = count_ == 0 || other.min_ < min_ ? other.min_ : min_;
+			max_ = count_ == 0 || other.max_ > max_ ? other.max_ : max_;
+			count_ += other.count_;
+
+			if( levels_.size() < other.levels_.size() ) {
+				levels_.resize( other.levels_.size() );
+				_update_capacities();
+			}
+			for( std::size_t h = 0; h < other.levels_.size(); ++h ) {
+				levels_[h].insert( levels_[h].end(), other.levels_[h].begin(), other.levels_[h].end() );
+			}
+			retained_ += other.retained_;
+			_compress();
+		}
+
+		boost::uint64_t count() const
+		{
+			return count_;
+		}
+
+		boost::uint64_t na_count() const
+		{
+			return na_count_;
+		}
+
+		boost::uint64_t nan_count() const
+		{
+			return nan_count_;
+		}
+
+		// Mixes salt into the state of the coin flips, so that sketches copied
+		// from one prototype and fed side by side make independent choices.
+		void reseed( boost::uint64_t salt )
+		{
+			// splitmix64 finalizer; xorshift needs a non-zero state
+			boost::uint64_t z = random_ + salt * 0x9E3779B97F4A7C15ull;
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			z ^= z >> 31;
+			random_ = z ? z : 0x9E3779B97F4A7C15ull;
+		}
+
+		double min_value() const
+		{
+			return min_;
+		}
+
+		double max_value() const
+		{
+			return max_;
+		}
+
+		// Approximate value at quantile q in [0, 1]; NaN if empty.
+		double quantile( double q ) const
+		{
+			if( count_ == 0 ) {
+				return std::numeric_limits< double >::quiet_NaN();
+			}
+			if( q <= 0.0 ) {
+				return min_;
+			}
+			if( q >= 1.0 ) {
+				return max_;
+			}
+
+			const std::vector< std::pair< double, boost::uint64_t > > items = _weighted_items();
+			const double target = q * double( _weight() );
+			double seen = 0.0;
+			for( std::size_t i = 0; i < items.size(); ++i ) {
+				seen += double( items[i].second );
+				if( seen >= target ) {
+					return items[i].first;
+				}
+			}
+			return max_;
+		}
+
+		// Approximate fraction of the values <= value.
+		double rank( double value ) const
+		{
+			if( count_ == 0 ) {
+				return std::numeric_limits< double >::quiet_NaN();
+			}
+			boost::uint64_t below = 0;
+			for( std::size_t h = 0; h < levels_.size(); ++h ) {
+				for( std::size_t i = 0; i < levels_[h].size(); ++i ) {
+					below += levels_[h][i] <= value ? (boost::uint64_t(1) << h) : 0;
+				}
+			}
+			return double( below ) / double( _weight() );
+		}
+
+	private:
+		// Levels shrink geometrically (factor 2/3) below the top one.
+		void _update_capacities()
+		{
+			capacities_.resize( levels_.size() );
+			total_capacity_ = 0;
+			for( std::size_t h = 0; h < levels_.size(); ++h ) {
+				const std::size_t depth = levels_.size() - 1 - h;
+				capacities_[h] = std::max( std::size_t( std::ceil( k_ * std::pow( 2.0 / 3.0, double( depth ) ) ) ), std::size_t(2) );
+				total_capacity_ += capacities_[h];
+			}
+		}
+
+		bool _coin()
+		{
+			// xorshift64
+			random_ ^= random_ << 13;
+			random_ ^= random_ >> 7;
+			random_ ^= random_ << 17;
+			return (random_ & 1) != 0;
+		}
+
+		void _compress()
+		{
+			while( retained_ >= total_capacity_ ) {
+				std::size_t h = 0;
+				while( levels_[h].size() < capacities_[h] ) {
+					++h;
+				}
+				if( h + 1 == levels_.size() ) {
+					levels_.push_back( std::vector< double >() );
+					_update_capacities();
+				}
+
+				std::vector< double >& level = levels_[h];
+				std::sort( level.begin(), level.end() );
+
+				// an odd item out stays behind
+				const std::size_t keep = level.size() % 2;
+				for( std::size_t i = keep + (_coin() ? 1 : 0); i < level.size(); i += 2 ) {
+					levels_[h + 1].push_back( level[i] );
+				}
+				retained_ -= (level.size() - keep) / 2;
+				level.erase( level.begin() + keep, level.end() );
+			}
+		}
+
+		boost::uint64_t _weight() const
+		{
+			boost::uint64_t result = 0;
+			for( std::size_t h = 0; h < levels_.size(); ++h ) {
+				result += boost::uint64_t( levels_[h].size() ) << h;
+			}
+			return result;
+		}
+
+		std::vector< std::pair< double, boost::uint64_t > > _weighted_items() const
+		{
+			std::vector< std::pair< double, boost::uint64_t > > items;
+			items.reserve( retained_ );
+			for( std::size_t h = 0; h < levels_.size(); ++h ) {
+				for( std::size_t i = 0; i < levels_[h].size(); ++i ) {
+					items.push_back( std::make_pair( levels_[h][i], boost::uint64_t(1) << h ) );
+				}
+			}
+			std::sort( items.begin(), items.end() );
+			return items;
+		}
+
+		std::size_t k_;
+		boost::uint64_t count_, na_count_, nan_count_;
+		double min_, max_;
+		boost::uint64_t random_;
+		std::size_t retained_, total_capacity_;
+		std::vector< std::size_t > capacities_;
+		std::vector< std::vector< double > > levels_;
+	};
+
+	namespace detail {
+
+		const std::size_t sketch_grain = 1 << 16;
+
+		// Gives the sketch of block b of a parallel build its own random
+		// choices; sketches without any keep their state.
+		template< typename Sketch >
+		void reseed_block( Sketch&, std::size_t )
+		{
+		}
+
+		inline void reseed_block( kll_sketch& sketch, std::size_t block )
+		{
+			sketch.reseed( block );
+		}
+
+		template< typename Policy, typename Sketch, typename ValueType >
+		void sketch_add( Sketch& sketch, const ValueType* data, std::size_t count )
+		{
+			typedef na_value_traits< ValueType > traits;
+			for( std::size_t i = 0; i < count; ++i ) {
+				if( Policy::is_na( data[i] ) ) {
+					sketch.add_na();
+				} else {
+					sketch.add( double( traits::get( data[i] ) ) );
+				}
+			}
+		}
+
+		template< typename Sketch, typename Array >
+		void slice_sketches( const Array& arr, tags::major_tag, std::vector< Sketch >& result )
+		{
+			typedef typename array_policy< Array >::type policy;
+			for( std::size_t i = 0; i < arr.minor_size(); ++i ) {
+				sketch_add< policy >( result[i], arr.data() + i * arr.stride(), arr.major_size() );
+			}
+		}
+
+		// Across the storage order: one sketch per lane, fed while sweeping
+		// the major slices in order.
+		template< typename Sketch, typename Array >
+		void slice_sketches( const Array& arr, tags::minor_tag, std::vector< Sketch >& result )
+		{
+			typedef typename array_policy< Array >::type policy;
+			for( std::size_t i = 0; i < arr.minor_size(); ++i ) {
+				const typename Array::value_type* slice = arr.data() + i * arr.stride();
+				for( std::size_t j = 0; j < arr.major_size(); ++j ) {
+					sketch_add< policy >( result[j], slice + j, 1 );
+				}
+			}
+		}
+
+	}
+
+	// Adds the values of vec to a copy of prototype (an empty, configured
+	// sketch). With more than one thread every thread sketches a block, from
+	// a copy reseeded with the block index, and the block sketches are merged
+	// in order.
+	template< typename Vector, typename Sketch >
+	Sketch sketch( const Vector& vec, const Sketch& prototype, const parallel_t& par = parallel_t( 1 ) )
+	{
+		typedef typename Vector::policy_type policy;
+		const std::size_t count = vec.size();
+		const std::size_t blocks = std::min( detail::parallel_threads( par ), std::max( count / detail::sketch_grain, std::size_t(1) ) );
+
+		std::vector< Sketch > partial( blocks, prototype );
+		const typename Vector::value_type* data = vec.data();
+		detail::parallel_for( blocks, 1, parallel_t( blocks ), [&]( std::size_t first, std::size_t last ) {
+			for( std::size_t b = first; b < last; ++b ) {
+				const std::size_t begin = count * b / blocks, end = count * (b + 1) / blocks;
+				if( b ) {
+					detail::reseed_block( partial[b], b );
+				}
+				detail::sketch_add< policy >( partial[b], data + begin, end - begin );
+			}
+		} );
+
+		for( std::size_t b = 1; b < blocks; ++b ) {
+			partial[0].merge( partial[b] );
+		}
+		return partial[0];
+	}
+
+	// One sketch per column (row), in order, in one pass over the array.
+	template< typename Array, typename Sketch >
+	std::vector< Sketch > column_sketches( const Array& arr, const Sketch& prototype )
+	{
+		std::vector< Sketch > result( arr.cols(), prototype );
+		detail::slice_sketches( arr, typename Array::column_tag(), result );
+		return result;
+	}
+
+	template< typename Array, typename Sketch >
+	std::vector< Sketch > row_sketches( const Array& arr, const Sketch& prototype )
+	{
+		std::vector< Sketch > result( arr.rows(), prototype );
+		detail::slice_sketches( arr, typename Array::row_tag(), result );
+		return result;
+	}
+
+}
@@ -0,0 +1,420 @@
+#pragma once
+#include <na_containers/na_vector.h>
+#include <boost/cstdint.hpp>
+#include <boost/iterator/iterator_facade.hpp>
+#include <boost/utility/string_ref.hpp>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace na {
+
+	namespace policies {
+
+		// A string_ref is NA when it points nowhere; an empty string still
+		// points into its arena.
+		class NaPolicyStringRef {
+		public:
+			typedef boost::string_ref value_type;
+
+		public:
+			static bool is_na( const value_type& val )
+			{
+				return val.data() == 0;
+			}
+
+			static const value_type get_na()
+			{
+				return value_type();
+			}
+		};
+
+	}
+
+	namespace detail {
+
+		template< typename Vector >
+		class string_iterator
+			: public boost::iterator_facade< string_iterator< Vector >,
+											 boost::string_ref,
+											 std::random_access_iterator_tag,
+											 boost::string_ref >
+		{
+		public:
+			string_iterator()
+				: vec_( nullptr ), index_( 0 )
+			{
+			}
+
+			string_iterator( const Vector* vec, std::size_t index )
+				: vec_( vec ), index_( index )
+			{
+			}
+
+		private:
+			friend class boost::iterator_core_access;
+
+			boost::string_ref dereference() const
+			{
+				return (*vec_)[index_];
+			}
+
+			void increment()
+			{
+				++index_;
+			}
+
+			void decrement()
+			{
+				--index_;
+			}
+
+			bool equal( const string_iterator& other ) const
+			{
+				return index_ == other.index_;
+			}
+
+			std::ptrdiff_t distance_to( const string_iterator& other ) const
+			{
+				return std::ptrdiff_t( other.index_ ) - std::ptrdiff_t( index_ );
+			}
+
+			void advance( std::ptrdiff_t diff )
+			{
+				index_ += diff;
+			}
+
+			const Vector* vec_;
+			std::size_t index_;
+		};
+
+	}
+
+	// Append-only string column: the characters of all strings back to back
+	// in one arena, plus size()+1 offsets into it (string i is
+	// [offset(i), offset(i+1)) ) and one NA bit per element. Adding a string
+	// costs no allocation of its own, only amortized growth of the two arrays.
+	//
+	// OffsetType bounds the arena: boost::uint32_t halves the offsets array
+	// for columns under 4 GiB of text, boost::uint64_t lifts the limit.
+	// Growing the arena past the limit throws std::length_error.
+	//
+	// Elements read as boost::string_ref into the arena, NA as a string_ref
+	// without data (NaPolicyStringRef); they stay valid until the next
+	// modification of the column. Elements cannot be changed in place.
+	template< typename OffsetType = boost::uint32_t, typename Allocator = std::allocator< char > >
+	class na_string_vector {
+	public:
+		typedef policies::NaPolicyStringRef policy_type;
+		typedef policy_type::value_type value_type;
+		typedef value_type const_reference;
+		typedef OffsetType offset_type;
+		typedef std::size_t size_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef Allocator allocator_type;
+
+		typedef detail::string_iterator< na_string_vector > const_iterator;
+		typedef const_iterator iterator;
+
+	private:
+		typedef std::vector< char, typename Allocator::template rebind< char >::other > char_container;
+		typedef std::vector< offset_type, typename Allocator::template rebind< offset_type >::other > offset_container;
+		typedef std::vector< detail::bit_word, typename Allocator::template rebind< detail::bit_word >::other > bit_container;
+
+	public:
+		static value_type get_na() {
+			return policy_type::get_na();
+		}
+
+	public:
+		na_string_vector()
+			: offsets_( 1, offset_type(0) )
+		{
+		}
+
+		template< typename InputIterator >
+		na_string_vector( InputIterator first, InputIterator last )
+			: offsets_( 1, offset_type(0) )
+		{
+			append( first, last );
+		}
+
+		// element access
+	public:
+		value_type operator[]( size_type index ) const
+		{
+			if( is_na( index ) ) {
+				return get_na();
+			}
+			return value_type( _chars() + offsets_[index], std::size_t( offsets_[index + 1] - offsets_[index] ) );
+		}
+
+		value_type at( size_type index ) const
+		{
+			if( index >= size() ) {
+				throw std::out_of_range( "na_string_vector::at" );
+			}
+			return (*this)[index];
+		}
+
+		value_type front() const
+		{
+			return (*this)[0];
+		}
+
+		value_type back() const
+		{
+			return (*this)[size() - 1];
+		}
+
+		bool is_na( size_type index ) const
+		{
+			return (na_[index / detail::bit_word_bits] >> (index % detail::bit_word_bits)) & 1;
+		}
+
+		const_iterator begin() const
+		{
+			return const_iterator( this, 0 );
+		}
+
+		const_iterator end() const
+		{
+			return const_iterator( this, size() );
+		}
+
+		const_iterator cbegin() const
+		{
+			return begin();
+		}
+
+		const_iterator cend() const
+		{
+			return end();
+		}
+
+		// modifiers
+	public:
+		void push_back( const value_type& val )
+		{
+			if( policy_type::is_na( val ) ) {
+				push_back( NA );
+				return;
+			}
+			const std::size_t size = chars_.size();
+			const offset_type end = _check_offset( size + val.size() );
+			if( val.data() >= chars_.data() && val.data() < chars_.data() + size ) {
+				// an element of this column: copy within the arena after growing it
+				const std::size_t from = val.data() - chars_.data();
+				chars_.resize( size + val.size() );
+				std::memcpy( chars_.data() + size, chars_.data() + from, val.size() );
+			} else {
+				chars_.insert( chars_.end(), val.begin(), val.end() );
+			}
+			// the offset goes in last, so no offset ever points past the arena
+			try {
+				_push_offset( end );
+			} catch( ... ) {
+				chars_.resize( size );
+				throw;
+			}
+		}
+
+		void push_back( const std::string& val )
+		{
+			push_back( value_type( val ) );
+		}
+
+		// A null pointer is NA.
+		void push_back( const char* val )
+		{
+			if( !val ) {
+				push_back( NA );
+				return;
+			}
+			push_back( value_type( val ) );
+		}
+
+		void push_back( const detail::_na_type& )
+		{
+			_push_offset( offset_type( chars_.size() ) );
+			_assign_na( size() - 1 );
+		}
+
+		// Appends a range of strings (anything convertible to string_ref, NA
+		// as a string_ref without data) with one arena allocation when the
+		// range can be walked twice.
+		template< typename InputIterator >
+		void append( InputIterator first, InputIterator last )
+		{
+			_append( first, last, typename std::iterator_traits< InputIterator >::iterator_category() );
+		}
+
+		// Appends another column: one block copy of its arena and a shifted
+		// copy of its offsets.
+		template< typename OtherOffset, typename OtherAllocator >
+		void append( const na_string_vector< OtherOffset, OtherAllocator >& other )
+		{
+			if( static_cast< const void* >( &other ) == this ) {
+				const na_string_vector< OtherOffset, OtherAllocator > copy( other );
+				append( copy );
+				return;
+			}
+
+			const size_type base_size = size();
+			const std::size_t base = chars_.size();
+			_check_offset( base + other.char_count() );
+
+			// reserve first: once the arena has grown, nothing below may throw
+			offsets_.reserve( offsets_.size() + other.size() );
+			na_.reserve( detail::bit_word_count( base_size + other.size() ) );
+			chars_.insert( chars_.end(), other.chars(), other.chars() + other.char_count() );
+			for( size_type i = 1; i <= other.size(); ++i ) {
+				offsets_.push_back( offset_type( base + other.offsets()[i] ) );
+			}
+			na_.resize( detail::bit_word_count( size() ), 0 );
+			for( size_type i = 0; i < other.size(); ++i ) {
+				if( other.is_na( i ) ) {
+					_assign_na( base_size + i );
+				}
+			}
+		}
+
+		void pop_back()
+		{
+			const size_type last = size() - 1;
+			if( is_na( last ) ) {
+				na_[last / detail::bit_word_bits] &= ~(detail::bit_word(1) << (last % detail::bit_word_bits));
+			}
+			offsets_.pop_back();
+			chars_.resize( offsets_.back() );
+			na_.resize( detail::bit_word_count( size() ) );
+		}
+
+		void clear()
+		{
+			chars_.clear();
+			offsets_.assign( 1, offset_type(0) );
+			na_.clear();
+		}
+
+		void swap( na_string_vector& x )
+		{
+			chars_.swap( x.chars_ );
+			offsets_.swap( x.offsets_ );
+			na_.swap( x.na_ );
+		}
+
+		// capacity
+	public:
+		size_type size() const
+		{
+			return offsets_.size() - 1;
+		}
+
+		bool empty() const
+		{
+			return size() == 0;
+		}
+
+		// Room for n strings of chars characters in total.
+		void reserve( size_type n, std::size_t chars )
+		{
+			offsets_.reserve( n + 1 );
+			chars_.reserve( chars );
+			na_.reserve( detail::bit_word_count( n ) );
+		}
+
+		void shrink_to_fit()
+		{
+			chars_.shrink_to_fit();
+			offsets_.shrink_to_fit();
+			na_.shrink_to_fit();
+		}
+
+		size_type count_na() const
+		{
+			size_type result = 0;
+			for( size_type w = 0; w < na_.size(); ++w ) {
+				result += detail::popcount( na_[w] );
+			}
+			return result;
+		}
+
+		// raw buffers
+	public:
+		std::size_t char_count() const
+		{
+			return chars_.size();
+		}
+
+		const char* chars() const
+		{
+			return chars_.data();
+		}
+
+		// size()+1 entries; NA elements span no characters.
+		const offset_type* offsets() const
+		{
+			return offsets_.data();
+		}
+
+	private:
+		template< typename InputIterator >
+		void _append( InputIterator first, InputIterator last, std::input_iterator_tag )
+		{
+			for( ; first != last; ++first ) {
+				push_back( value_type( *first ) );
+			}
+		}
+
+		template< typename ForwardIterator >
+		void _append( ForwardIterator first, ForwardIterator last, std::forward_iterator_tag )
+		{
+			std::size_t count = 0, length = 0;
+			for( ForwardIterator it = first; it != last; ++it ) {
+				length += value_type( *it ).size();
+				++count;
+			}
+			_check_offset( chars_.size() + length );
+			reserve( size() + count, chars_.size() + length );
+			_append( first, last, std::input_iterator_tag() );
+		}
+
+		// A pointer for empty strings to point at while the arena has no buffer.
+		const char* _chars() const
+		{
+			static const char empty = 0;
+			return chars_.empty() ? &empty : chars_.data();
+		}
+
+		static offset_type _check_offset( std::size_t end )
+		{
+			if( end > std::size_t( (std::numeric_limits< offset_type >::max)() ) ) {
+				throw std::length_error( "na_string_vector: arena exceeds the offset type" );
+			}
+			return offset_type( end );
+		}
+
+		// Grows the NA plane first: if the offset push then throws, the extra
+		// zero word is harmless.
+		void _push_offset( offset_type end )
+		{
+			na_.resize( detail::bit_word_count( size() + 1 ), 0 );
+			offsets_.push_back( end );
+		}
+
+		void _assign_na( size_type index )
+		{
+			na_[index / detail::bit_word_bits] |= detail::bit_word(1) << (index % detail::bit_word_bits);
+		}
+
+		char_container chars_;
+		offset_container offsets_;
+		bit_container na_;
+	};
+
+}
@@ -0,0 +1,336 @@
+#pragma once
+#include <na_containers/na_vector.h>
+#include <na_containers/array2d.h>
+#include <na_containers/gather.h>
+#include <na_containers/na_string_vector.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+namespace na {
+
+	namespace detail {
+
+		// Rows of a column at the given positions; invalid_index gives NA.
+		template< typename Vector >
+		Vector take_positions( const Vector& data, const std::vector< std::size_t >& positions )
+		{
+			Vector result( positions.size() );
+			gather( result.data(), data.data(), data.size(), positions.data(), positions.size(), Vector::get_na() );
+			return result;
+		}
+
+		template< typename OffsetType, typename Allocator >
+		na_string_vector< OffsetType, Allocator > take_positions( const na_string_vector< OffsetType, Allocator >& data, const std::vector< std::size_t >& positions )
+		{
+			na_string_vector< OffsetType, Allocator > result;
+			for( std::size_t i = 0; i < positions.size(); ++i ) {
+				if( positions[i] == invalid_index ) {
+					result.push_back( NA );
+				} else {
+					result.push_back( data[ positions[i] ] );
+				}
+			}
+			return result;
+		}
+
+		// Packed masks have no data(); their elements are copied one by one.
+		template< class NaPolicy, typename Allocator >
+		na_vector< bool, NaPolicy, Allocator > take_positions( const na_vector< bool, NaPolicy, Allocator >& data, const std::vector< std::size_t >& positions )
+		{
+			na_vector< bool, NaPolicy, Allocator > result( positions.size(), NA );
+			for( std::size_t i = 0; i < positions.size(); ++i ) {
+				if( positions[i] != invalid_index ) {
+					result.set( i, data.get( positions[i] ) );
+				}
+			}
+			return result;
+		}
+
+		class table_column_base {
+		public:
+			virtual ~table_column_base()
+			{
+			}
+
+			virtual std::size_t size() const = 0;
+			virtual const std::type_info& type() const = 0;
+			virtual std::shared_ptr< table_column_base > clone() const = 0;
+			virtual std::shared_ptr< table_column_base > take( const std::vector< std::size_t >& positions ) const = 0;
+		};
+
+		template< typename Vector >
+		class table_column : public table_column_base {
+		public:
+			explicit table_column( const Vector& data )
+				: data_( data )
+			{
+			}
+
+			explicit table_column( Vector&& data )
+				: data_( std::move( data ) )
+			{
+			}
+
+			std::size_t size() const
+			{
+				return data_.size();
+			}
+
+			const std::type_info& type() const
+			{
+				return typeid( Vector );
+			}
+
+			std::shared_ptr< table_column_base > clone() const
+			{
+				return std::make_shared< table_column >( data_ );
+			}
+
+			std::shared_ptr< table_column_base > take( const std::vector< std::size_t >& positions ) const
+			{
+				return std::make_shared< table_column >( take_positions( data_, positions ) );
+			}
+
+			Vector data_;
+		};
+
+	}
+
+	// Column store: named columns of possibly different na_vector types, or
+	// na_string_vector, that share one row count.
+	//
+	// Columns are held by shared pointer. project(), and copies of a table,
+	// share them instead of copying; the non-const column() detaches a shared
+	// column before handing it out. Row selection gathers every column through
+	// one index list. scan() hands a column to a kernel as a contiguous range,
+	// so a query only touches the columns it names.
+	//
+	// Errors (unknown or duplicate names, wrong column types, mismatching row
+	// counts) are reported by exceptions from <stdexcept> and std::bad_cast.
+	class table {
+		typedef std::pair< std::string, std::shared_ptr< detail::table_column_base > > entry_type;
+
+	public:
+		typedef std::size_t size_type;
+
+	public:
+		table()
+			: rows_( 0 )
+		{
+		}
+
+		size_type rows() const
+		{
+			return rows_;
+		}
+
+		size_type cols() const
+		{
+			return columns_.size();
+		}
+
+		std::vector< std::string > names() const
+		{
+			std::vector< std::string > result;
+			for( auto it = columns_.begin(); it != columns_.end(); ++it ) {
+				result.push_back( it->first );
+			}
+			return result;
+		}
+
+		bool has_column( const std::string& name ) const
+		{
+			return _find( name ) != columns_.end();
+		}
+
+		// The first column sets the row count; later ones have to match it.
+		template< typename Vector >
+		void add_column( const std::string& name, Vector column )
+		{
+			if( has_column( name ) ) {
+				throw std::invalid_argument( "na::table: duplicate column " + name );
+			}
+			if( !columns_.empty() && column.size() != rows_ ) {
+				throw std::invalid_argument( "na::table: row count mismatch in column " + name );
+			}
+
+			rows_ = column.size();
+			columns_.push_back( entry_type( name, std::make_shared< detail::table_column< Vector > >( std::move( column ) ) ) );
+		}
+
+		void remove_column( const std::string& name )
+		{
+			columns_.erase( _get( name ) );
+			if( columns_.empty() ) {
+				rows_ = 0;
+			}
+		}
+
+		template< typename Vector >
+		const Vector& column( const std::string& name ) const
+		{
+			return _typed< Vector >( *_get( name ) ).data_;
+		}
+
+		template< typename Vector >
+		Vector& column( const std::string& name )
+		{
+			auto it = _get( name );
+			if( it->second.use_count() > 1 ) {
+				it->second = it->second->clone();
+			}
+			return _typed< Vector >( *it ).data_;
+		}
+
+		// Calls f( first, last ) with the column's elements as a contiguous range.
+		template< typename Vector, typename Function >
+		Function scan( const std::string& name, Function f ) const
+		{
+			const Vector& data = column< Vector >( name );
+			f( data.data(), data.data() + data.size() );
+			return f;
+		}
+
+		// Table of the named columns, in the given order, sharing their storage.
+		table project( const std::vector< std::string >& names ) const
+		{
+			table result;
+			result.rows_ = rows_;
+			for( auto it = names.begin(); it != names.end(); ++it ) {
+				result.columns_.push_back( *_get( *it ) );
+			}
+			return result;
+		}
+
+		// Rows whose mask entry is true; the mask needs rows() entries, another
+		// length throws std::invalid_argument.
+		template< typename Mask >
+		table select_rows( const Mask& mask ) const
+		{
+			return _take( detail::mask_positions( mask, rows_ ) );
+		}
+
+		// Rows at the given positions, in order; NA and out-of-range
+		// positions give rows of NA.
+		template< typename IndexVector >
+		table take_rows( const IndexVector& indices ) const
+		{
+			return _take( detail::resolve_indices( indices, rows_ ) );
+		}
+
+		// Builds a table with one column per array column, each one block copy
+		// out of a column_major array.
+		template< typename Vector, typename Array >
+		static table from_array2d( const Array& arr, const std::vector< std::string >& names )
+		{
+			if( names.size() != arr.cols() ) {
+				throw std::invalid_argument( "na::table: need one name per column" );
+			}
+
+			table result;
+			for( size_type c = 0; c < arr.cols(); ++c ) {
+				Vector column;
+				_copy_column( arr, c, column, typename Array::column_tag() );
+				result.add_column( names[c], std::move( column ) );
+			}
+			return result;
+		}
+
+		// Homogeneous array of the named columns, which must all be of type
+		// Vector. Each column is one block copy into a column_major array.
+		template< typename Array, typename Vector >
+		Array to_array2d( const std::vector< std::string >& names ) const
+		{
+			Array result( rows_, names.size() );
+			for( size_type c = 0; c < names.size(); ++c ) {
+				_store_column( column< Vector >( names[c] ), result, c, typename Array::column_tag() );
+			}
+			return result;
+		}
+
+	private:
+		typedef std::vector< entry_type >::iterator entry_iterator;
+		typedef std::vector< entry_type >::const_iterator const_entry_iterator;
+
+		const_entry_iterator _find( const std::string& name ) const
+		{
+			for( auto it = columns_.begin(); it != columns_.end(); ++it ) {
+				if( it->first == name ) {
+					return it;
+				}
+			}
+			return columns_.end();
+		}
+
+		const_entry_iterator _get( const std::string& name ) const
+		{
+			const_entry_iterator it = _find( name );
+			if( it == columns_.end() ) {
+				throw std::out_of_range( "na::table: no column " + name );
+			}
+			return it;
+		}
+
+		entry_iterator _get( const std::string& name )
+		{
+			return columns_.begin() + (static_cast< const table& >( *this )._get( name ) - columns_.begin());
+		}
+
+		template< typename Vector >
+		static detail::table_column< Vector >& _typed( const entry_type& entry )
+		{
+			if( entry.second->type() != typeid( Vector ) ) {
+				throw std::bad_cast();
+			}
+			return static_cast< detail::table_column< Vector >& >( *entry.second );
+		}
+
+		table _take( const std::vector< size_type >& positions ) const
+		{
+			table result;
+			result.rows_ = positions.size();
+			for( auto it = columns_.begin(); it != columns_.end(); ++it ) {
+				result.columns_.push_back( entry_type( it->first, it->second->take( positions ) ) );
+			}
+			return result;
+		}
+
+		template< typename Array, typename Vector >
+		static void _copy_column( const Array& arr, size_type col, Vector& column, tags::major_tag )
+		{
+			const typename Array::value_type* first = arr.data() + col * arr.stride();
+			column.assign( first, first + arr.major_size() );
+		}
+
+		template< typename Array, typename Vector >
+		static void _copy_column( const Array& arr, size_type col, Vector& column, tags::minor_tag )
+		{
+			column.resize( arr.minor_size() );
+			for( size_type r = 0; r < arr.minor_size(); ++r ) {
+				column[r] = arr.data()[ r * arr.stride() + col ];
+			}
+		}
+
+		template< typename Vector, typename Array >
+		static void _store_column( const Vector& column, Array& arr, size_type col, tags::major_tag )
+		{
+			std::copy( column.data(), column.data() + column.size(), arr.data() + col * arr.stride() );
+		}
+
+		template< typename Vector, typename Array >
+		static void _store_column( const Vector& column, Array& arr, size_type col, tags::minor_tag )
+		{
+			for( size_type r = 0; r < column.size(); ++r ) {
+				arr.data()[ r * arr.stride() + col ] = column[r];
+			}
+		}
+
+		size_type rows_;
+		std::vector< entry_type > columns_;
+	};
+
+}
@@ -1,9 +1,13 @@
 #pragma once
 #include <boost/integer_traits.hpp>
+#include <boost/integer.hpp>
 #include <boost/iterator/filter_iterator.hpp>
 #include <boost/optional.hpp>
 #include <boost/iterator/zip_iterator.hpp>
+#include <na_containers/gather.h>
+#include <na_containers/parallel.h>
 #include <algorithm>
+#include <cstring>
 #include <vector>
 
 #define noexcept
@@ -16,7 +20,7 @@ namespace na {
 		};
 
 		template< typename T > struct special_value_default {
-			static const T value = boost::integral_traits<T>::const_min;
+			static const T value = boost::integer_traits<T>::const_min;
 		};
 		template<> struct special_value_default< double > {
 			static const double value;
@@ -25,6 +29,38 @@ namespace na {
 			static const float value;
 		};
 
+		// Access to the plain value behind a policy's value_type, for kernels
+		// that need to do arithmetic on non-NA elements.
+		template< typename ValueType >
+		struct na_value_traits {
+			typedef ValueType raw_type;
+
+			static const raw_type& get( const ValueType& val )
+			{
+				return val;
+			}
+
+			static ValueType make( const raw_type& val )
+			{
+				return val;
+			}
+		};
+
+		template< typename ValueType >
+		struct na_value_traits< boost::optional< ValueType > > {
+			typedef ValueType raw_type;
+
+			static const raw_type& get( const boost::optional< ValueType >& val )
+			{
+				return *val;
+			}
+
+			static boost::optional< ValueType > make( const raw_type& val )
+			{
+				return boost::optional< ValueType >( val );
+			}
+		};
+
 		template< typename Iterator, typename Filter >
 		class filtered_list {
 		public:
@@ -97,6 +133,47 @@ namespace na {
 			}
 		};
 
+		// Floating point NA as one specific quiet NaN (payload 1954, as in R).
+		// NaNs produced by arithmetic have other bit patterns and are not NA.
+		// is_na compares the bits as an integer, which vectorizes where
+		// val != val would not tell NA from other NaNs. Arithmetic on an NA
+		// operand yields a NaN; on x86 the payload of the operand survives,
+		// so it reads as NA again, but only NaN-ness itself is guaranteed.
+		// All other values, including -FLT_MAX/-DBL_MAX, stay usable.
+		template< typename ValueType >
+		class NaPolicyNaN {
+			static_assert( sizeof(ValueType) == 4 || sizeof(ValueType) == 8, "NaPolicyNaN needs float or double" );
+
+		public:
+			typedef ValueType value_type;
+			typedef typename boost::uint_t< sizeof(ValueType) * 8 >::exact bits_type;
+
+			static const bits_type na_bits = sizeof(ValueType) == 8 ? bits_type( 0x7FF80000000007A2ull ) : bits_type( 0x7FC007A2u );
+
+		public:
+			static bool is_na( const value_type& val )
+			{
+				return to_bits( val ) == na_bits;
+			}
+
+			static const value_type get_na()
+			{
+				value_type result;
+				std::memcpy( &result, &na_bits, sizeof(result) );
+				return result;
+			}
+
+			static bits_type to_bits( const value_type& val )
+			{
+				bits_type bits;
+				std::memcpy( &bits, &val, sizeof(bits) );
+				return bits;
+			}
+		};
+
+		template< typename ValueType >
+		const typename NaPolicyNaN< ValueType >::bits_type NaPolicyNaN< ValueType >::na_bits;
+
 		template< typename ValueType >
 		class NaPolicyOptional {
 		public:
@@ -105,7 +182,7 @@ namespace na {
 		public:
 			static bool is_na( const value_type& val )
 			{
-				return val.is_initialized();
+				return !val.is_initialized();
 			}
 
 			static const value_type get_na()
@@ -121,6 +198,7 @@ namespace na {
 	template< typename ValueType, class NaPolicy = policies::NaPolicySV< ValueType >, typename Allocator = std::allocator<ValueType> >
 	class na_vector : private NaPolicy {
 	public:
+		typedef NaPolicy policy_type;
 		typedef typename NaPolicy::value_type value_type;
 		typedef std::vector< value_type, Allocator > container_type;
 
@@ -179,6 +257,20 @@ namespace na {
 
 		}
 
+		// Allocates n elements and fills them from several threads, each
+		// first-touching its own part of the buffer (see default_init_allocator).
+		na_vector (size_type n, const value_type& val, const parallel_t& par)
+			: data_( n )
+		{
+			detail::parallel_fill( data_.data(), n, val, par );
+		}
+
+		na_vector (size_type n, const detail::_na_type&, const parallel_t& par)
+			: data_( n )
+		{
+			detail::parallel_fill( data_.data(), n, get_na(), par );
+		}
+
 		template <class InputIterator>
 		na_vector (InputIterator first, InputIterator last,
 			const allocator_type& alloc = allocator_type())
@@ -301,6 +393,29 @@ namespace na {
 			data_.pop_back();
 		}
 
+		// gather / scatter
+	public:
+		// Elements at the given positions, in order. indices is an na_vector
+		// of an integral type; NA, negative and out-of-range positions give NA.
+		template< typename IndexVector >
+		na_vector take( const IndexVector& indices ) const
+		{
+			const std::vector< std::size_t > positions = detail::resolve_indices( indices, size() );
+
+			na_vector result( positions.size() );
+			detail::gather( result.data(), data(), size(), positions.data(), positions.size(), get_na() );
+			return result;
+		}
+
+		// data[ indices[k] ] = values[k]. NA and out-of-range positions are skipped;
+		// values needs as many elements as indices.
+		template< typename IndexVector, typename ValueVector >
+		void put( const IndexVector& indices, const ValueVector& values )
+		{
+			const std::vector< std::size_t > positions = detail::resolve_indices( indices, size() );
+			detail::scatter( data(), size(), positions.data(), positions.size(), values );
+		}
+
 		// erase
 	public:
 		iterator erase (iterator position)
@@ -393,6 +508,28 @@ namespace na {
 			data_.resize( n, get_na() );
 		}
 
+		// Grows without filling: with default_init_allocator the new elements
+		// are left uninitialized, for the caller to first-touch them.
+		void resize_default_init (size_type n)
+		{
+			data_.resize( n );
+		}
+
+		// Grows without the serial fill; the new elements are filled in parallel.
+		void resize (size_type n, const value_type& val, const parallel_t& par)
+		{
+			const size_type old_size = data_.size();
+			resize_default_init( n );
+			if( n > old_size ) {
+				detail::parallel_fill( data_.data() + old_size, n - old_size, val, par );
+			}
+		}
+
+		void resize (size_type n, const detail::_na_type&, const parallel_t& par)
+		{
+			resize( n, get_na(), par );
+		}
+
 		void reserve (size_type n)
 		{
 			data_.reserve( n );
@@ -433,5 +570,31 @@ namespace na {
 	};
 
 	// relational operators missing for now. never used those.
+
+	// Whether any element is NA. Blocks are tested without early exit, so
+	// for bitwise policies (NaPolicySV on integers, NaPolicyNaN) the inner
+	// loop vectorizes; kernels can check this once and then run on data()
+	// without NA handling.
+	template< typename Vector >
+	bool has_na( const Vector& vec )
+	{
+		typedef typename Vector::policy_type policy;
+		const std::size_t block_size = 1024;
+		const typename Vector::value_type* data = vec.data();
+
+		for( std::size_t first = 0; first < vec.size(); first += block_size ) {
+			const std::size_t last = std::min( first + block_size, vec.size() );
+			bool found = false;
+			for( std::size_t i = first; i < last; ++i ) {
+				found |= policy::is_na( data[i] );
+			}
+			if( found ) {
+				return true;
+			}
+		}
+		return false;
+	}
 }
 
+#include <na_containers/na_bool_vector.h>
+
@@ -0,0 +1,205 @@
+#pragma once
+#include <na_containers/na_vector.h>
+#include <algorithm>
+#include <stdexcept>
+
+// Elementwise operations over two or three na_vectors of equal length.
+//
+// The vectors are processed in blocks: first the NA flags of all operands
+// are or-ed into one mask for the block, then the operation runs over the
+// plain values of the whole block (at NA positions every operand reads as
+// 1, which keeps integer division defined), and finally the mask selects
+// between NA and the result. None of the three loops branches per element,
+// so for special-value and NaN policies they vectorize; the result is NA
+// wherever any operand is.
+//
+// The result has the type of the first operand; op receives the plain
+// values and its result is converted to the first operand's value type.
+
+namespace na {
+
+	namespace ops {
+
+		struct add {
+			template< typename T, typename U >
+			T operator()( const T& a, const U& b ) const { return a + b; }
+		};
+
+		struct subtract {
+			template< typename T, typename U >
+			T operator()( const T& a, const U& b ) const { return a - b; }
+		};
+
+		struct multiply {
+			template< typename T, typename U >
+			T operator()( const T& a, const U& b ) const { return a * b; }
+		};
+
+		struct divide {
+			template< typename T, typename U >
+			T operator()( const T& a, const U& b ) const { return a / b; }
+		};
+
+		struct minimum {
+			template< typename T, typename U >
+			T operator()( const T& a, const U& b ) const { return b < a ? T(b) : a; }
+		};
+
+		struct maximum {
+			template< typename T, typename U >
+			T operator()( const T& a, const U& b ) const { return a < b ? T(b) : a; }
+		};
+
+		// a * b + c
+		struct fma {
+			template< typename T, typename U, typename V >
+			T operator()( const T& a, const U& b, const V& c ) const { return a * b + c; }
+		};
+
+	}
+
+	namespace detail {
+
+		const std::size_t zip_block_size = 256;
+
+		template< typename Vector >
+		struct zip_operand {
+			typedef typename Vector::policy_type policy;
+			typedef na_value_traits< typename Vector::value_type > traits;
+			typedef typename traits::raw_type raw_type;
+
+			static raw_type get( const typename Vector::value_type& val, bool is_na )
+			{
+				return is_na ? raw_type(1) : traits::get( val );
+			}
+		};
+
+		inline void check_lengths( std::size_t a, std::size_t b )
+		{
+			if( a != b ) {
+				throw std::invalid_argument( "na::zip_transform: operands differ in length" );
+			}
+		}
+
+	}
+
+	template< typename Vector1, typename Vector2, typename Op >
+	Vector1 zip_transform( const Vector1& a, const Vector2& b, Op op )
+	{
+		typedef detail::zip_operand< Vector1 > A;
+		typedef detail::zip_operand< Vector2 > B;
+		typedef typename A::raw_type result_type;
+
+		detail::check_lengths( a.size(), b.size() );
+
+		Vector1 result;
+		result.resize_default_init( a.size() );
+
+		const typename Vector1::value_type na = Vector1::get_na();
+		const typename Vector1::value_type* pa = a.data();
+		const typename Vector2::value_type* pb = b.data();
+		typename Vector1::value_type* out = result.data();
+
+		unsigned char mask[ detail::zip_block_size ];
+		result_type values[ detail::zip_block_size ];
+
+		for( std::size_t first = 0; first < a.size(); first += detail::zip_block_size ) {
+			const std::size_t count = std::min( detail::zip_block_size, a.size() - first );
+
+			for( std::size_t i = 0; i < count; ++i ) {
+				mask[i] = A::policy::is_na( pa[first + i] ) | B::policy::is_na( pb[first + i] );
+			}
+			for( std::size_t i = 0; i < count; ++i ) {
+				values[i] = result_type( op( A::get( pa[first + i], mask[i] != 0 ), B::get( pb[first + i], mask[i] != 0 ) ) );
+			}
+			for( std::size_t i = 0; i < count; ++i ) {
+				out[first + i] = mask[i] ? na : A::traits::make( values[i] );
+			}
+		}
+		return result;
+	}
+
+	template< typename Vector1, typename Vector2, typename Vector3, typename Op >
+	Vector1 zip_transform( const Vector1& a, const Vector2& b, const Vector3& c, Op op )
+	{
+		typedef detail::zip_operand< Vector1 > A;
+		typedef detail::zip_operand< Vector2 > B;
+		typedef detail::zip_operand< Vector3 > C;
+		typedef typename A::raw_type result_type;
+
+		detail::check_lengths( a.size(), b.size() );
+		detail::check_lengths( a.size(), c.size() );
+
+		Vector1 result;
+		result.resize_default_init( a.size() );
+
+		const typename Vector1::value_type na = Vector1::get_na();
+		const typename Vector1::value_type* pa = a.data();
+		const typename Vector2::value_type* pb = b.data();
+		const typename Vector3::value_type* pc = c.data();
+		typename Vector1::value_type* out = result.data();
+
+		unsigned char mask[ detail::zip_block_size ];
+		result_type values[ detail::zip_block_size ];
+
+		for( std::size_t first = 0; first < a.size(); first += detail::zip_block_size ) {
+			const std::size_t count = std::min( detail::zip_block_size, a.size() - first );
+
+			for( std::size_t i = 0; i < count; ++i ) {
+				mask[i] = A::policy::is_na( pa[first + i] ) | B::policy::is_na( pb[first + i] ) | C::policy::is_na( pc[first + i] );
+			}
+			for( std::size_t i = 0; i < count; ++i ) {
+				const bool is_na = mask[i] != 0;
+				values[i] = result_type( op( A::get( pa[first + i], is_na ), B::get( pb[first + i], is_na ), C::get( pc[first + i], is_na ) ) );
+			}
+			for( std::size_t i = 0; i < count; ++i ) {
+				out[first + i] = mask[i] ? na : A::traits::make( values[i] );
+			}
+		}
+		return result;
+	}
+
+	template< typename Vector1, typename Vector2 >
+	Vector1 add( const Vector1& a, const Vector2& b )
+	{
+		return zip_transform( a, b, ops::add() );
+	}
+
+	template< typename Vector1, typename Vector2 >
+	Vector1 subtract( const Vector1& a, const Vector2& b )
+	{
+		return zip_transform( a, b, ops::subtract() );
+	}
+
+	template< typename Vector1, typename Vector2 >
+	Vector1 multiply( const Vector1& a, const Vector2& b )
+	{
+		return zip_transform( a, b, ops::multiply() );
+	}
+
+	template< typename Vector1, typename Vector2 >
+	Vector1 divide( const Vector1& a, const Vector2& b )
+	{
+		return zip_transform( a, b, ops::divide() );
+	}
+
+	template< typename Vector1, typename Vector2 >
+	Vector1 minimum( const Vector1& a, const Vector2& b )
+	{
+		return zip_transform( a, b, ops::minimum() );
+	}
+
+	template< typename Vector1, typename Vector2 >
+	Vector1 maximum( const Vector1& a, const Vector2& b )
+	{
+		return zip_transform( a, b, ops::maximum() );
+	}
+
+	// a * b + c
+	template< typename Vector1, typename Vector2, typename Vector3 >
+	Vector1 fma( const Vector1& a, const Vector2& b, const Vector3& c )
+	{
+		return zip_transform( a, b, c, ops::fma() );
+	}
+
+}
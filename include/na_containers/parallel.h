@@ -0,0 +1,98 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace na {
+
+	// Requests the parallel variant of a constructor or member, e.g.
+	//
+	//   array2d< na_vector< double, policies::NaPolicySV<double>, default_init_allocator<double> > >
+	//       arr( rows, cols, NA, parallel_t() );
+	//
+	// threads == 0 uses one thread per hardware thread.
+	struct parallel_t {
+		explicit parallel_t( std::size_t threads = 0 )
+			: threads( threads )
+		{
+		}
+
+		std::size_t threads;
+	};
+
+	namespace detail {
+
+		inline std::size_t parallel_threads( const parallel_t& par )
+		{
+			if( par.threads ) {
+				return par.threads;
+			}
+			return std::max( std::size_t( std::thread::hardware_concurrency() ), std::size_t(1) );
+		}
+
+		// Splits [0, count) into one contiguous range per thread, each at
+		// least grain long, and calls f( first, last ) for every range. The
+		// ranges are deterministic for a given count and thread count, so a
+		// later pass with the same partition runs each range on memory its
+		// thread touched first. The calling thread takes the first range.
+		// The first exception thrown by f is rethrown after all ranges ended.
+		template< typename Function >
+		void parallel_for( std::size_t count, std::size_t grain, const parallel_t& par, Function f )
+		{
+			const std::size_t threads = std::min( parallel_threads( par ), std::max( count / std::max( grain, std::size_t(1) ), std::size_t(1) ) );
+			if( threads < 2 ) {
+				if( count ) {
+					f( std::size_t(0), count );
+				}
+				return;
+			}
+
+			std::vector< std::exception_ptr > errors( threads );
+			std::vector< std::thread > workers;
+			workers.reserve( threads - 1 );
+
+			for( std::size_t t = 1; t < threads; ++t ) {
+				const std::size_t first = count * t / threads;
+				const std::size_t last  = count * (t + 1) / threads;
+				std::exception_ptr* error = &errors[t];
+				workers.push_back( std::thread( [=]() {
+					try {
+						f( first, last );
+					} catch( ... ) {
+						*error = std::current_exception();
+					}
+				} ) );
+			}
+
+			try {
+				f( std::size_t(0), count / threads );
+			} catch( ... ) {
+				errors[0] = std::current_exception();
+			}
+
+			for( std::size_t t = 0; t < workers.size(); ++t ) {
+				workers[t].join();
+			}
+			for( std::size_t t = 0; t < threads; ++t ) {
+				if( errors[t] ) {
+					std::rethrow_exception( errors[t] );
+				}
+			}
+		}
+
+		// Elements per thread below which a fill is not worth a thread.
+		const std::size_t parallel_fill_grain = 1 << 16;
+
+		template< typename ValueType >
+		void parallel_fill( ValueType* data, std::size_t count, const ValueType& val, const parallel_t& par )
+		{
+			parallel_for( count, parallel_fill_grain, par, [=]( std::size_t first, std::size_t last ) {
+				std::fill( data + first, data + last, val );
+			} );
+		}
+
+	}
+
+}
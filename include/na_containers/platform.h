@@ -0,0 +1,18 @@
+#pragma once
+
+// Compiler specific helpers shared by the containers.
+
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#define NA_PREFETCH( address ) _mm_prefetch( reinterpret_cast< const char* >( address ), _MM_HINT_T0 )
+#elif defined(__GNUC__)
+#define NA_PREFETCH( address ) __builtin_prefetch( (address) )
+#else
+#define NA_PREFETCH( address )
+#endif
+
+// AVX2 is only used where the compiler says it may (/arch:AVX2, -mavx2).
+#if defined(__AVX2__)
+#define NA_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
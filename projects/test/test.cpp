@@ -1,21 +1,1463 @@
 #include <na_containers/na_vector.h>
 #include <na_containers/array2d.h>
+#include <na_containers/na_fill.h>
+#include <na_containers/na_segmented_vector.h>
+#include <na_containers/na_concurrent_vector.h>
+#include <na_containers/cow_vector.h>
+#include <na_containers/aligned_allocator.h>
+#include <na_containers/default_init_allocator.h>
+#include <na_containers/array2d_fixed.h>
+#include <na_containers/array2d_stats.h>
+#include <na_containers/na_table.h>
+#include <na_containers/na_string_vector.h>
+#include <na_containers/na_convert.h>
+#include <na_containers/na_zip.h>
+#include <na_containers/na_scan.h>
+#include <na_containers/na_sketch.h>
+#include <na_containers/na_shared.h>
+#include <na_containers/na_concurrent_array2d.h>
+#include <na_containers/na_broadcast.h>
+#include <na_containers/na_frozen.h>
+#include <na_containers/na_correlation.h>
+#include <algorithm>
 #include <array>
+#include <cfloat>
 #include <cmath>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <typeinfo>
+#include <vector>
 using std::wcout;
 using na::NA;
 
-struct nan_value {
-	static const float value;
+static int failures = 0;
+
+#define CHECK( expr ) check( (expr), #expr, __LINE__ )
+
+static void check( bool ok, const char* expr, int line )
+{
+	if( !ok ) {
+		wcout << L"line " << line << L": check failed: " << expr << L'\n';
+		++failures;
+	}
+}
+
+static void test_fill()
+{
+	typedef na::na_vector< float > vector_type;
+
+	// unsigned gaps descend without wrapping, wide signed ranges do not overflow
+	na::na_vector< unsigned > u;
+	u.push_back( 10u ); u.push_back( NA ); u.push_back( 2u );
+	na::interpolate( u );
+	CHECK( u[1] == 6u );
+
+	na::na_vector< int > i;
+	i.push_back( -2000000000 ); i.push_back( NA ); i.push_back( 2000000000 );
+	na::interpolate( i );
+	CHECK( i[1] == 0 );
+
+	// a gap spanning NA-free blocks on both sides, with a limit
+	vector_type v( 1000, 1.0f );
+	v[0] = vector_type::get_na();
+	for( std::size_t k = 400; k < 600; ++k ) {
+		v[k] = vector_type::get_na();
+	}
+	v[600] = 202.0f;
+	auto w = na::interpolate_copy( v, 150 );
+	CHECK( vector_type::policy_type::is_na( w[0] ) );
+	CHECK( w[500] == 102.0f );
+	CHECK( w[549] == 151.0f && vector_type::policy_type::is_na( w[550] ) );
+	CHECK( w[999] == 1.0f );
+
+	// interleaved (row-major columns) matches the contiguous kernel per column
+	array2d< vector_type, order::row_major > rm( 7, 3 );
+	for( std::size_t r = 0; r < 7; ++r ) {
+		for( std::size_t c = 0; c < 3; ++c ) {
+			rm.dereference( r, c ) = (r % (c + 2)) ? vector_type::get_na() : float( r * r + c );
+		}
+	}
+	auto filled = na::interpolate_cols_copy( rm );
+	for( std::size_t c = 0; c < 3; ++c ) {
+		vector_type col;
+		for( std::size_t r = 0; r < 7; ++r ) {
+			col.push_back( rm.dereference( r, c ) );
+		}
+		na::interpolate( col );
+		for( std::size_t r = 0; r < 7; ++r ) {
+			CHECK( filled.dereference( r, c ) == col[r] );
+		}
+	}
+
+	// reshaping to a wider stride with fewer slices keeps the kept elements
+	array2d< vector_type, order::column_major > cm( 4, 4 );
+	for( std::size_t r = 0; r < 4; ++r ) {
+		for( std::size_t c = 0; c < 4; ++c ) {
+			cm.dereference( r, c ) = float( r * 4 + c );
+		}
+	}
+	cm.reshape( 8, 2 );
+	CHECK( cm.rows() == 8 && cm.cols() == 2 );
+	for( std::size_t r = 0; r < 8; ++r ) {
+		for( std::size_t c = 0; c < 2; ++c ) {
+			CHECK( r < 4 ? cm.dereference( r, c ) == float( r * 4 + c ) : vector_type::policy_type::is_na( cm.dereference( r, c ) ) );
+		}
+	}
+
+	// cells a reshape or an in-place resize brings into view are NA, both
+	// past the kept rows and in new columns, whether or not the stride moves
+	array2d< vector_type, order::column_major > grown( 4, 4 );
+	for( std::size_t r = 0; r < 4; ++r ) {
+		for( std::size_t c = 0; c < 4; ++c ) {
+			grown.dereference( r, c ) = float( r * 4 + c );
+		}
+	}
+	grown.resize( 2, 8 );
+	bool exposed_na = true;
+	for( std::size_t r = 0; r < 2; ++r ) {
+		for( std::size_t c = 0; c < 8; ++c ) {
+			exposed_na = exposed_na && ( c < 4 ? grown.dereference( r, c ) == float( r * 4 + c ) : vector_type::policy_type::is_na( grown.dereference( r, c ) ) );
+		}
+	}
+	CHECK( exposed_na );
+	grown.reshape( 4, 4 );
+	for( std::size_t r = 0; r < 4; ++r ) {
+		for( std::size_t c = 0; c < 4; ++c ) {
+			exposed_na = exposed_na && ( r < 2 ? grown.dereference( r, c ) == float( r * 4 + c ) : vector_type::policy_type::is_na( grown.dereference( r, c ) ) );
+		}
+	}
+	CHECK( exposed_na );
+
+	array2d< vector_type, order::column_major > reserved( 4, 4 );
+	for( std::size_t r = 0; r < 4; ++r ) {
+		for( std::size_t c = 0; c < 4; ++c ) {
+			reserved.dereference( r, c ) = float( r * 4 + c );
+		}
+	}
+	reserved.reserve( 8, 8 );
+	reserved.reshape( 7, 7 );
+	for( std::size_t r = 0; r < 7; ++r ) {
+		for( std::size_t c = 0; c < 7; ++c ) {
+			exposed_na = exposed_na && ( r < 4 && c < 4 ? reserved.dereference( r, c ) == float( r * 4 + c ) : vector_type::policy_type::is_na( reserved.dereference( r, c ) ) );
+		}
+	}
+	CHECK( exposed_na );
+}
+
+static void test_segmented_vector()
+{
+	typedef na::na_segmented_vector< float, na::policies::NaPolicySV< float >, 16 > vector_type;
+
+	vector_type v;
+	v.push_back( 0.0f );
+	const float* first = &v[0];
+	for( int k = 1; k < 100; ++k ) {
+		if( k % 7 == 0 ) {
+			v.push_back( NA );
+		} else {
+			v.push_back( float( k ) );
+		}
+	}
+	// growing adds chunks, it never moves elements
+	CHECK( &v[0] == first );
+	CHECK( v.size() == 100 && v.count_na() == 14 );
+
+	float sum = 0;
+	for( auto x : v.filtered() ) {
+		sum += x;
+	}
+	CHECK( sum == 4950.0f - 7.0f * (14 * 15 / 2) );
+
+	vector_type w( v );
+	w.resize( 20 );
+	w.shrink_to_fit();
+	CHECK( w.size() == 20 && w.capacity() == 32 && v.size() == 100 );
+}
+
+static void test_concurrent_vector()
+{
+	typedef na::na_concurrent_vector< double, na::policies::NaPolicySV< double >, 16 > vector_type;
+
+	const int producers = 4;
+	const int per_producer = 20000;
+	vector_type v;
+	std::atomic< bool > done( false );
+	bool prefix_ok = true;
+
+	// a reader running alongside the producers only ever sees written elements
+	std::thread reader( [&] {
+		std::size_t seen = 0;
+		while( !done.load() ) {
+			const std::size_t n = v.size();
+			prefix_ok = prefix_ok && n >= seen;
+			for( std::size_t k = seen; k < n; ++k ) {
+				prefix_ok = prefix_ok && (vector_type::policy_type::is_na( v[k] ) || v[k] >= 0);
+			}
+			seen = n;
+		}
+	} );
+
+	std::vector< std::thread > threads;
+	for( int t = 0; t < producers; ++t ) {
+		threads.push_back( std::thread( [&v, t, per_producer] {
+			for( int k = 0; k < per_producer; ++k ) {
+				if( k % 5 == 0 ) {
+					v.push_back( NA );
+				} else {
+					v.push_back( double( t * per_producer + k ) );
+				}
+			}
+		} ) );
+	}
+	for( auto& t : threads ) {
+		t.join();
+	}
+	done = true;
+	reader.join();
+
+	CHECK( prefix_ok );
+	CHECK( v.size() == std::size_t( producers * per_producer ) );
+
+	// every value was stored exactly once
+	std::vector< char > seen( producers * per_producer, 0 );
+	std::size_t nas = 0;
+	bool unique = true;
+	for( auto x : v ) {
+		if( vector_type::policy_type::is_na( x ) ) {
+			++nas;
+		} else {
+			unique = unique && !seen[ std::size_t( x ) ]++;
+		}
+	}
+	CHECK( unique && nas == std::size_t( producers * per_producer / 5 ) );
+}
+
+static void test_cow_vector()
+{
+	typedef na::cow_vector< na::na_vector< float > > vector_type;
+	typedef array2d< vector_type, order::row_major > array_type;
+
+	vector_type v( 10, 1.0f );
+	vector_type w( v );
+	CHECK( w.shares_with( v ) && w.is_shared() );
+	w[0] = 2.0f;
+	CHECK( !w.shares_with( v ) && v[0] == 1.0f && w[0] == 2.0f );
+
+	// array copies share until written; const access does not detach
+	array_type a( 3, 3 );
+	for( std::size_t r = 0; r < 3; ++r ) {
+		for( std::size_t c = 0; c < 3; ++c ) {
+			a.dereference( r, c ) = float( r * 3 + c );
+		}
+	}
+	array_type b( a );
+	const array_type& cb = b;
+	CHECK( cb.dereference( 2, 2 ) == 8.0f );
+	b.dereference( 2, 2 ) = 9.0f;
+	CHECK( a.dereference( 2, 2 ) == 8.0f && b.dereference( 2, 2 ) == 9.0f );
+
+	// copies released on another thread leave the writer as sole owner
+	vector_type shared( 1000, 1.0f );
+	std::vector< std::thread > readers;
+	std::atomic< int > sum( 0 );
+	for( int t = 0; t < 4; ++t ) {
+		vector_type copy( shared );
+		readers.push_back( std::thread( [copy, &sum] {
+			int local = 0;
+			for( auto x : copy.get() ) {
+				local += int( x );
+			}
+			sum += local;
+		} ) );
+	}
+	for( auto& t : readers ) {
+		t.join();
+	}
+	readers.clear();
+	CHECK( sum == 4000 && !shared.is_shared() );
+	const float* before = shared.get().data();
+	shared[0] = 5.0f;
+	CHECK( shared.get().data() == before );
+}
+
+static void test_aligned_stride()
+{
+	typedef na::na_vector< float, na::policies::NaPolicySV< float >, na::aligned_allocator< float, 64 > > vector_type;
+	typedef array2d< vector_type, order::row_major > array_type;
+
+	array_type a( 5, 13 );
+	CHECK( a.stride() == 16 && std::size_t( a.data() ) % 64 == 0 );
+	for( std::size_t r = 0; r < 5; ++r ) {
+		for( std::size_t c = 0; c < 13; ++c ) {
+			a.dereference( r, c ) = float( r * 100 + c );
+		}
+	}
+	a.reserve( 10, 20 );
+	CHECK( a.stride() == 32 && a.dereference( 4, 12 ) == 412.0f );
+	a.resize( 40, 40 );
+	CHECK( a.stride() == 48 && a.dereference( 4, 12 ) == 412.0f );
+
+	// a 4K stride gets one more alignment unit against cache aliasing
+	array_type b( 3, 1024 );
+	CHECK( b.stride() == 1040 );
+
+	// no slice has room, so the widest stride is 0
+	array_type e( 4, 4 );
+	e.reshape( 100, 0 );
+	CHECK( e.rows() == 100 && e.cols() == 0 );
+	e.reshape( 4, 4 );
+	CHECK( e.rows() == 4 && e.cols() == 4 && e.stride() == 16 );
+
+	// 24-byte elements: every slice start stays 64-byte aligned
+	typedef boost::optional< std::array< double, 2 > > wide_type;
+	typedef na::na_vector< std::array< double, 2 >, na::policies::NaPolicyOptional< std::array< double, 2 > >, na::aligned_allocator< wide_type, 64 > > wide_vector;
+	array2d< wide_vector, order::column_major > w( 5, 3 );
+	CHECK( sizeof(wide_type) % 64 != 0 );
+	for( std::size_t c = 0; c < w.cols(); ++c ) {
+		CHECK( std::size_t( &w.dereference( 0, c ) ) % 64 == 0 );
+	}
+}
+
+static void test_fixed_array()
+{
+	typedef array2d_fixed< float, 3, 4, order::row_major > row_array;
+	typedef array2d_fixed< float, 3, 4 > col_array;
+
+	// storage is inline, without size members
+	CHECK( sizeof(row_array) == 12 * sizeof(float) );
+	CHECK( row_array::stride() == 4 && col_array::stride() == 3 );
+
+	row_array a;
+	col_array b;
+	for( std::size_t r = 0; r < 3; ++r ) {
+		for( std::size_t c = 0; c < 4; ++c ) {
+			a.dereference( r, c ) = float( r * 10 + c );
+			b.dereference( r, c ) = float( r * 10 + c );
+		}
+	}
+
+	float sum = 0;
+	for( auto col : a.col_seq() ) {
+		for( auto x : col ) {
+			sum += x;
+		}
+	}
+	CHECK( sum == 138.0f );
+	// operator[] selects a column
+	CHECK( a[2][1] == 12.0f && b[2][1] == 12.0f );
+
+	a.dereference( 1, 1 ) = row_array::value_type( -FLT_MAX );
+	na::ffill_cols( a );
+	CHECK( a.dereference( 1, 1 ) == 1.0f );
+}
+
+// Two-pass sample variance of the non-NA values, as reference.
+template< typename Vector >
+static double reference_variance( const Vector& values )
+{
+	double sum = 0, n = 0;
+	for( auto x : values ) {
+		if( !Vector::policy_type::is_na( x ) ) {
+			sum += x;
+			n += 1;
+		}
+	}
+	double m2 = 0;
+	for( auto x : values ) {
+		if( !Vector::policy_type::is_na( x ) ) {
+			m2 += (x - sum / n) * (x - sum / n);
+		}
+	}
+	return m2 / (n - 1);
+}
+
+template< typename Array >
+static void check_slice_stats( const Array& arr )
+{
+	typedef na::na_vector< double > vector_type;
+
+	auto cols = na::column_stats( arr );
+	auto rows = na::row_stats( arr );
+	for( std::size_t c = 0; c < arr.cols(); ++c ) {
+		vector_type col;
+		for( std::size_t r = 0; r < arr.rows(); ++r ) {
+			col.push_back( arr.dereference( r, c ) );
+		}
+		const double expected = reference_variance( col );
+		CHECK( cols[c].count == arr.rows() - 1 && std::fabs( cols[c].variance - expected ) < 1e-6 * expected );
+	}
+	for( std::size_t r = 1; r < arr.rows(); ++r ) {
+		vector_type row;
+		for( std::size_t c = 0; c < arr.cols(); ++c ) {
+			row.push_back( arr.dereference( r, c ) );
+		}
+		const double expected = reference_variance( row );
+		CHECK( std::fabs( rows[r].variance - expected ) < 1e-6 * expected );
+	}
+	CHECK( rows[0].count == 0 && rows[0].na_count == arr.cols() );
+}
+
+static void test_stats()
+{
+	typedef na::na_vector< double > vector_type;
+
+	// a leading NA must not leave the first block unshifted
+	vector_type v;
+	v.push_back( NA );
+	for( int k = 0; k < 200; ++k ) {
+		v.push_back( 1e8 + (k * 37 % 101) / 100.0 );
+	}
+	const auto st = na::vector_stats( v );
+	const double expected = reference_variance( v );
+	CHECK( st.count == 200 && st.na_count == 1 );
+	CHECK( std::fabs( st.variance - expected ) < 1e-6 * expected );
+	CHECK( std::fabs( st.mean - 1e8 ) < 1.0 );
+
+	// the same over columns and rows, on both storage paths
+	array2d< vector_type, order::row_major > rm( 300, 5 );
+	array2d< vector_type, order::column_major > cm( 300, 5 );
+	for( std::size_t r = 0; r < 300; ++r ) {
+		for( std::size_t c = 0; c < 5; ++c ) {
+			const double x = r ? 1e8 + double( (r * 37 + c * 11) % 101 ) / 100.0 : vector_type::get_na();
+			rm.dereference( r, c ) = x;
+			cm.dereference( r, c ) = x;
+		}
+	}
+	check_slice_stats( rm );
+	check_slice_stats( cm );
+
+	na::na_vector< int > iv;
+	iv.push_back( 3 ); iv.push_back( NA ); iv.push_back( -5 );
+	const auto is = na::vector_stats( iv );
+	CHECK( is.min == -5 && is.max == 3 && is.count == 2 && is.sum == -2.0 );
+}
+
+template< typename Array >
+static void check_selection()
+{
+	Array a( 6, 5 );
+	for( std::size_t r = 0; r < 6; ++r ) {
+		for( std::size_t c = 0; c < 5; ++c ) {
+			const bool na = (r == 2 && c == 1) || (r == 4 && c == 3);
+			a.dereference( r, c ) = na ? -FLT_MAX : float( r * 10 + c );
+		}
+	}
+
+	auto complete = a.select_rows( na::complete_rows( a ) );
+	CHECK( complete.rows() == 4 && complete.cols() == 5 );
+	CHECK( complete.dereference( 2, 0 ) == 30.0f && complete.dereference( 3, 4 ) == 54.0f );
+
+	std::vector< int > mask( 5, 0 );
+	mask[0] = mask[4] = 1;
+	auto picked = a.select_cols( mask );
+	CHECK( picked.cols() == 2 && picked.dereference( 3, 1 ) == 34.0f );
+
+	auto large = a.select_rows_if( []( typename Array::const_row_slice row ) { return row[0] > 25; } );
+	CHECK( large.rows() == 3 && large.dereference( 0, 0 ) == 30.0f );
+	auto left = a.select_cols_if( []( typename Array::const_column_slice col ) { return col[0] < 2; } );
+	CHECK( left.cols() == 2 && left.dereference( 5, 1 ) == 51.0f );
+}
+
+static void test_selection()
+{
+	check_selection< array2d< na::na_vector< float >, order::row_major > >();
+	check_selection< array2d< na::na_vector< float >, order::column_major > >();
+}
+
+static void test_take()
+{
+	typedef na::na_vector< float > vector_type;
+
+	vector_type v;
+	for( int k = 0; k < 10; ++k ) {
+		v.push_back( float( k ) );
+	}
+
+	// NA, negative and out-of-range positions give NA
+	na::na_vector< long long > idx;
+	idx.push_back( 4 ); idx.push_back( NA ); idx.push_back( -1 ); idx.push_back( 10 ); idx.push_back( 0 );
+	const vector_type t = v.take( idx );
+	CHECK( t.size() == 5 && t[0] == 4.0f && t[4] == 0.0f );
+	CHECK( vector_type::policy_type::is_na( t[1] ) && vector_type::policy_type::is_na( t[2] ) && vector_type::policy_type::is_na( t[3] ) );
+
+	// optional and floating point index vectors
+	na::na_vector< int, na::policies::NaPolicyOptional< int > > opt;
+	opt.push_back( 7 ); opt.push_back( NA ); opt.push_back( -3 );
+	const vector_type to = v.take( opt );
+	CHECK( to[0] == 7.0f && vector_type::policy_type::is_na( to[1] ) && vector_type::policy_type::is_na( to[2] ) );
+
+	na::na_vector< double > fidx;
+	fidx.push_back( 2.0 ); fidx.push_back( -2.5 ); fidx.push_back( 1e30 );
+	const vector_type tf = v.take( fidx );
+	CHECK( tf[0] == 2.0f && vector_type::policy_type::is_na( tf[1] ) && vector_type::policy_type::is_na( tf[2] ) );
+
+	na::na_vector< double > dv( 10, 1.0 );
+	na::na_vector< int > pos;
+	pos.push_back( 3 ); pos.push_back( 11 ); pos.push_back( NA );
+	dv.put( pos, na::na_vector< double >( 3, 7.0 ) );
+	CHECK( dv[3] == 7.0 && dv[0] == 1.0 );
+
+	array2d< vector_type, order::column_major > a( 5, 4 );
+	for( std::size_t r = 0; r < 5; ++r ) {
+		for( std::size_t c = 0; c < 4; ++c ) {
+			a.dereference( r, c ) = float( r * 10 + c );
+		}
+	}
+	auto rows = a.take_rows( idx );
+	CHECK( rows.rows() == 5 && rows.dereference( 0, 2 ) == 42.0f && rows.dereference( 4, 3 ) == 3.0f );
+	CHECK( vector_type::policy_type::is_na( rows.dereference( 2, 0 ) ) );
+	auto cols = a.take_cols( opt );
+	CHECK( cols.cols() == 3 && vector_type::policy_type::is_na( cols.dereference( 0, 0 ) ) );
+}
+
+static void test_table()
+{
+	typedef na::na_vector< float > float_vector;
+	typedef na::na_vector< int > int_vector;
+
+	na::table t;
+	float_vector x;
+	int_vector y;
+	for( int k = 0; k < 6; ++k ) {
+		x.push_back( float( k ) );
+		y.push_back( k * 10 );
+	}
+	t.add_column( "x", x );
+	t.add_column( "y", y );
+	CHECK( t.rows() == 6 && t.cols() == 2 );
+
+	bool rejected = false;
+	try {
+		t.add_column( "z", float_vector( 3, 1.0f ) );
+	} catch( std::invalid_argument& ) {
+		rejected = true;
+	}
+	CHECK( rejected );
+
+	// projections share columns until written
+	na::table p = t.project( std::vector< std::string >( 1, "y" ) );
+	p.column< int_vector >( "y" )[0] = 99;
+	CHECK( p.cols() == 1 && t.column< int_vector >( "y" )[0] == 0 );
+
+	std::vector< bool > mask( 6, false );
+	mask[1] = mask[4] = true;
+	na::table r = t.select_rows( mask );
+	CHECK( r.rows() == 2 && r.column< float_vector >( "x" )[1] == 4.0f && r.column< int_vector >( "y" )[0] == 10 );
+
+	array2d< float_vector, order::column_major > a( 4, 3 );
+	for( std::size_t row = 0; row < 4; ++row ) {
+		for( std::size_t c = 0; c < 3; ++c ) {
+			a.dereference( row, c ) = float( row * 10 + c );
+		}
+	}
+	std::vector< std::string > names;
+	names.push_back( "a" ); names.push_back( "b" ); names.push_back( "c" );
+	na::table f = na::table::from_array2d< float_vector >( a, names );
+	CHECK( f.rows() == 4 && f.column< float_vector >( "b" )[3] == 31.0f );
+	auto back = f.to_array2d< array2d< float_vector, order::row_major >, float_vector >( names );
+	CHECK( back.dereference( 2, 2 ) == 22.0f );
+}
+
+static void test_parallel_init()
+{
+	typedef na::na_vector< double, na::policies::NaPolicySV< double >, na::default_init_allocator< double > > vector_type;
+	typedef na::na_vector< float, na::policies::NaPolicySV< float >, na::default_init_allocator< float, na::aligned_allocator< float, 64 > > > aligned_vector;
+
+	vector_type v( 1000000, NA, na::parallel_t() );
+	CHECK( v.size() == 1000000 && v[0] == vector_type::get_na() && v[999999] == vector_type::get_na() );
+
+	vector_type w( 300000, 2.5, na::parallel_t( 3 ) );
+	w.resize( 500000, 1.0, na::parallel_t( 4 ) );
+	CHECK( w[299999] == 2.5 && w[300000] == 1.0 && w[499999] == 1.0 );
+
+	array2d< aligned_vector, order::row_major > a( 1000, 777, NA, na::parallel_t( 4 ) );
+	bool all_na = true;
+	for( std::size_t r = 0; r < a.rows(); ++r ) {
+		for( std::size_t c = 0; c < a.cols(); ++c ) {
+			all_na = all_na && a.dereference( r, c ) == aligned_vector::get_na();
+		}
+	}
+	CHECK( all_na && a.stride() % 16 == 0 );
+
+	a.dereference( 3, 4 ) = 7.0f;
+	a.resize( 2000, 800, na::parallel_t() );
+	CHECK( a.dereference( 3, 4 ) == 7.0f && a.dereference( 1999, 799 ) == aligned_vector::get_na() );
+}
+
+static void test_profile()
+{
+	typedef na::na_vector< float > vector_type;
+
+#ifdef NA_ARRAY2D_PROFILE
+	array2d< vector_type, order::row_major > a( 50, 40 );
+	for( std::size_t c = 0; c < 40; ++c ) {
+		for( std::size_t r = 0; r < 50; ++r ) {
+			a.dereference( r, c ) = 1.0f;
+		}
+	}
+	const na::detail::access_counters& profile = a.access_profile();
+	CHECK( profile.dereferences == 2000 && profile.dereferences_strided == 49 * 40 );
+
+	for( auto it = a.col_begin(); it != a.col_end(); ++it ) {
+		for( auto& x : *it ) {
+			x += 1.0f;
+		}
+	}
+	CHECK( profile.minor_slices == 40 && profile.minor_elements == 2000 );
+	CHECK( profile.strided_visits() > profile.contiguous_visits() );
+
+	// a copy starts a profile of its own
+	auto copy = a;
+	CHECK( copy.access_profile().dereferences == 0 );
+#else
+	// without profiling an array holds only its container and extents
+	CHECK( sizeof( array2d< vector_type > ) == sizeof( vector_type ) + 4 * sizeof( std::size_t ) );
+#endif
+}
+
+static void test_mask()
+{
+	typedef na::na_vector< float > vector_type;
+
+	// Kleene logic over all nine combinations
+	na::na_mask a, b;
+	for( int i = 0; i < 3; ++i ) {
+		for( int j = 0; j < 3; ++j ) {
+			if( i == 2 ) { a.push_back( NA ); } else { a.push_back( i == 0 ); }
+			if( j == 2 ) { b.push_back( NA ); } else { b.push_back( j == 0 ); }
+		}
+	}
+	const na::na_mask both = a & b, either = a | b, negated = !a;
+	for( std::size_t k = 0; k < 9; ++k ) {
+		const boost::logic::tribool x = a[k], y = b[k];
+		const boost::logic::tribool e = x && y, f = x || y, g = !x;
+		CHECK( boost::logic::indeterminate( e ) ? both.is_na( k ) : (!both.is_na( k ) && both.is_true( k ) == bool( e )) );
+		CHECK( boost::logic::indeterminate( f ) ? either.is_na( k ) : (!either.is_na( k ) && either.is_true( k ) == bool( f )) );
+		CHECK( boost::logic::indeterminate( g ) ? negated.is_na( k ) : (!negated.is_na( k ) && negated.is_true( k ) == bool( g )) );
+	}
+
+	// operands and masks of another length are rejected
+	bool rejected = false;
+	try {
+		na::na_mask shorter( 5, true );
+		shorter &= a;
+	} catch( std::invalid_argument& ) {
+		rejected = true;
+	}
+	CHECK( rejected );
+
+	array2d< vector_type, order::column_major > arr( 10, 3 );
+	for( std::size_t r = 0; r < 10; ++r ) {
+		arr.dereference( r, 1 ) = float( r );
+	}
+	rejected = false;
+	try {
+		arr.select_rows( std::vector< bool >( 4, true ) );
+	} catch( std::invalid_argument& ) {
+		rejected = true;
+	}
+	CHECK( rejected );
+
+	na::na_mask rows( 10, false );
+	rows[2] = true; rows[7] = true; rows[9] = NA;
+	auto picked = arr.select_rows( rows );
+	CHECK( picked.rows() == 2 && picked.dereference( 1, 1 ) == 7.0f );
+
+	// a mask as a table column survives row selection and take
+	na::table t;
+	t.add_column( "x", vector_type( 10, 1.0f ) );
+	t.add_column( "m", rows );
+	na::table selected = t.select_rows( rows );
+	CHECK( selected.rows() == 2 && selected.column< na::na_mask >( "m" ).count_true() == 2 );
+	na::na_vector< int > idx;
+	idx.push_back( 9 ); idx.push_back( NA ); idx.push_back( 2 );
+	na::table taken = t.take_rows( idx );
+	const na::na_mask& m = taken.column< na::na_mask >( "m" );
+	CHECK( m.is_na( 0 ) && m.is_na( 1 ) && m.is_true( 2 ) );
+	na::table masks;
+	masks.add_column( "m", na::na_mask() );
+	CHECK( masks.rows() == 0 && masks.cols() == 1 );
+}
+
+// Allocator whose allocations of elements of type *failing_type fail.
+static const std::type_info* failing_type = nullptr;
+
+template< typename T >
+struct failing_allocator : std::allocator< T > {
+	template< typename U >
+	struct rebind {
+		typedef failing_allocator< U > other;
+	};
+
+	failing_allocator()
+	{
+	}
+
+	template< typename U >
+	failing_allocator( const failing_allocator< U >& )
+	{
+	}
+
+	T* allocate( std::size_t n )
+	{
+		if( failing_type && *failing_type == typeid( T ) ) {
+			throw std::bad_alloc();
+		}
+		return std::allocator< T >::allocate( n );
+	}
 };
-const float nan_value::value = std::numeric_limits<float>::quiet_NaN();
+
+static void test_string_vector()
+{
+	na::na_string_vector<> s;
+	s.push_back( "abc" );
+	s.push_back( NA );
+	s.push_back( "" );
+	s.push_back( std::string( "xyz" ) );
+	s.push_back( static_cast< const char* >( nullptr ) );
+	CHECK( s.size() == 5 && s[0] == "abc" && s.is_na( 1 ) && !s.is_na( 2 ) && s[2].empty() && s.is_na( 4 ) );
+	CHECK( s.char_count() == 6 && s.count_na() == 2 );
+
+	// appending an element of the column itself copies within the arena
+	s.push_back( s[0] );
+	CHECK( s.back() == "abc" );
+
+	na::na_string_vector< boost::uint64_t > wide;
+	wide.push_back( NA );
+	wide.append( s );
+	CHECK( wide.size() == s.size() + 1 && wide.is_na( 0 ) && wide[1] == "abc" && wide.count_na() == 3 );
+
+	// a push_back failing in the arena, the offsets or the NA plane leaves no
+	// offset past the arena and no stray characters
+	const std::type_info* planes[] = { &typeid( char ), &typeid( boost::uint32_t ), &typeid( na::detail::bit_word ) };
+	for( int p = 0; p < 3; ++p ) {
+		na::na_string_vector< boost::uint32_t, failing_allocator< char > > f;
+		bool failed = false;
+		for( int k = 0; k < 200 && !failed; ++k ) {
+			const std::size_t size = f.size(), chars = f.char_count();
+			failing_type = k >= 3 ? planes[p] : nullptr;
+			try {
+				f.push_back( "text" );
+			} catch( std::bad_alloc& ) {
+				failed = true;
+				CHECK( f.size() == size && f.char_count() == chars );
+			}
+		}
+		failing_type = nullptr;
+		CHECK( failed );
+		f.push_back( "next" );
+		CHECK( f.back() == "next" && f.char_count() == 4 * f.size() );
+	}
+}
+
+static void test_nan_policy()
+{
+	typedef na::policies::NaPolicyNaN< double > double_policy;
+	typedef na::policies::NaPolicyNaN< float > float_policy;
+	typedef na::na_vector< double, double_policy > double_vector;
+	typedef na::na_vector< float, float_policy > float_vector;
+
+	// NA is one NaN payload; other NaNs and the extreme values are ordinary
+	CHECK( double_policy::is_na( double_policy::get_na() ) && double_policy::get_na() != double_policy::get_na() );
+	CHECK( !double_policy::is_na( std::numeric_limits< double >::quiet_NaN() ) && !double_policy::is_na( -DBL_MAX ) );
+	CHECK( float_policy::is_na( float_policy::get_na() ) && !float_policy::is_na( std::numeric_limits< float >::quiet_NaN() ) );
+
+	double_vector d( 10, 1.0 );
+	CHECK( !na::has_na( d ) );
+	d[3] = double_vector::get_na();
+	CHECK( na::has_na( d ) );
+	na::ffill( d );
+	CHECK( d[3] == 1.0 );
+
+	float_vector f( 5000, 2.0f );
+	f[4999] = float_vector::get_na();
+	const auto st = na::vector_stats( f );
+	CHECK( na::has_na( f ) && st.count == 4999 && st.na_count == 1 );
+}
+
+static void test_convert()
+{
+	typedef na::na_vector< double, na::policies::NaPolicyOptional< double > > optional_vector;
+	typedef na::na_vector< double > special_vector;
+	typedef na::na_vector< double, na::policies::NaPolicyNaN< double > > nan_vector;
+	typedef na::na_vector< float > float_vector;
+
+	optional_vector o;
+	o.push_back( 1.5 ); o.push_back( NA ); o.push_back( 3.0 );
+	const special_vector s = na::convert< special_vector >( o );
+	CHECK( s[0] == 1.5 && s[1] == -DBL_MAX && s[2] == 3.0 );
+	const nan_vector n = na::convert< nan_vector >( s );
+	CHECK( n[0] == 1.5 && nan_vector::policy_type::is_na( n[1] ) );
+	const optional_vector back = na::convert< optional_vector >( n );
+	CHECK( *back[0] == 1.5 && !back[1] && *back[2] == 3.0 );
+	const float_vector f = na::convert< float_vector >( n );
+	CHECK( f[1] == -FLT_MAX && f[2] == 3.0f );
+
+	array2d< special_vector, order::row_major > a( 3, 4 );
+	for( std::size_t r = 0; r < 3; ++r ) {
+		for( std::size_t c = 0; c < 4; ++c ) {
+			a.dereference( r, c ) = r == c ? special_vector::get_na() : double( r * 4 + c );
+		}
+	}
+	auto b = na::convert_array< array2d< nan_vector, order::row_major > >( a );
+	CHECK( nan_vector::policy_type::is_na( b.dereference( 1, 1 ) ) && b.dereference( 2, 3 ) == 11.0 );
+}
+
+static void test_zip()
+{
+	typedef na::na_vector< double > double_vector;
+	typedef na::na_vector< int > int_vector;
+	typedef na::na_vector< double, na::policies::NaPolicyOptional< double > > optional_vector;
+
+	double_vector a, b, c;
+	int_vector x, y;
+	optional_vector o;
+	for( int k = 0; k < 1000; ++k ) {
+		a.push_back( k ); b.push_back( 2 * k ); c.push_back( 1 );
+		x.push_back( k ); y.push_back( k % 7 + 1 );
+		o.push_back( double( k ) );
+	}
+	b[5] = double_vector::get_na();
+	c[700] = double_vector::get_na();
+	y[14] = int_vector::get_na();
+	o[3] = boost::none;
+
+	// NA in any operand gives NA, across block boundaries
+	const double_vector sum = na::add( a, b );
+	CHECK( sum[4] == 12.0 && sum[5] == double_vector::get_na() );
+	const double_vector f = na::fma( a, b, c );
+	CHECK( f[10] == 201.0 && f[700] == double_vector::get_na() && f[5] == double_vector::get_na() );
+	const int_vector m = na::minimum( x, y );
+	CHECK( m[8] == 2 && m[14] == int_vector::get_na() );
+	const int_vector q = na::zip_transform( x, y, []( int p, int r ) { return p / r; } );
+	CHECK( q[13] == 1 && q[14] == int_vector::get_na() );
+
+	// mixed policies take the policy of the first operand
+	const double_vector mo = na::multiply( a, o );
+	CHECK( mo[3] == double_vector::get_na() && mo[4] == 16.0 );
+	const optional_vector om = na::add( o, a );
+	CHECK( !om[3] && *om[2] == 4.0 );
+
+	bool rejected = false;
+	try {
+		na::add( a, double_vector( 3, 1.0 ) );
+	} catch( std::invalid_argument& ) {
+		rejected = true;
+	}
+	CHECK( rejected );
+}
+
+// Serial cumulative sum with the given NA handling, as reference.
+template< typename Vector >
+static Vector reference_cumsum( const Vector& in, na::na_handling handling )
+{
+	Vector out( in );
+	typename Vector::value_type acc = 0;
+	bool poisoned = false;
+	for( std::size_t k = 0; k < in.size(); ++k ) {
+		if( Vector::policy_type::is_na( in[k] ) ) {
+			acc = handling == na::na_reset ? 0 : acc;
+			poisoned = poisoned || handling == na::na_propagate;
+			continue;
+		}
+		acc += in[k];
+		out[k] = poisoned ? Vector::get_na() : acc;
+	}
+	return out;
+}
+
+static void test_scan()
+{
+	typedef na::na_vector< long long > vector_type;
+
+	vector_type v;
+	for( int k = 0; k < 300000; ++k ) {
+		if( k % 1000 == 7 ) {
+			v.push_back( NA );
+		} else {
+			v.push_back( (k * 7919ll) % 13 - 6 );
+		}
+	}
+
+	const na::na_handling handlings[] = { na::na_skip, na::na_reset, na::na_propagate };
+	for( int h = 0; h < 3; ++h ) {
+		vector_type serial( v ), parallel( v );
+		na::cumsum( serial, handlings[h] );
+		na::cumsum( parallel, handlings[h], na::parallel_t( 4 ) );
+		const vector_type expected = reference_cumsum( v, handlings[h] );
+		CHECK( std::equal( serial.begin(), serial.end(), expected.begin() ) );
+		CHECK( std::equal( parallel.begin(), parallel.end(), serial.begin() ) );
+	}
+
+	vector_type m( v );
+	na::cummax( m, na::na_skip, na::parallel_t( 3 ) );
+	CHECK( m[6] == 6 && vector_type::policy_type::is_na( m[7] ) && m[299999] == 6 );
+
+	na::na_vector< double > p;
+	p.push_back( 2.0 ); p.push_back( NA ); p.push_back( 3.0 );
+	na::cumprod( p );
+	CHECK( p[2] == 6.0 && na::na_vector< double >::policy_type::is_na( p[1] ) );
+
+	// along the strided axis the result matches the contiguous one
+	array2d< vector_type, order::row_major > ar( 50, 70 );
+	array2d< vector_type, order::column_major > ac( 50, 70 );
+	for( std::size_t r = 0; r < 50; ++r ) {
+		for( std::size_t c = 0; c < 70; ++c ) {
+			const long long x = (r * 31 + c * 17) % 11 == 0 ? vector_type::get_na() : (long long)( (r * 3 + c) % 5 );
+			ar.dereference( r, c ) = x;
+			ac.dereference( r, c ) = x;
+		}
+	}
+	na::cumsum_cols( ar, na::na_reset, na::parallel_t( 3 ) );
+	na::cumsum_cols( ac, na::na_reset );
+	bool same = true;
+	for( std::size_t r = 0; r < 50; ++r ) {
+		for( std::size_t c = 0; c < 70; ++c ) {
+			same = same && ar.dereference( r, c ) == ac.dereference( r, c );
+		}
+	}
+	CHECK( same );
+}
+
+static void test_sketch()
+{
+	typedef na::na_vector< double > vector_type;
+	typedef na::na_vector< double, na::policies::NaPolicyNaN< double > > nan_vector;
+
+	// a uniform grid, so true quantiles are known
+	vector_type v;
+	for( int k = 0; k < 400000; ++k ) {
+		v.push_back( k % 100 == 0 ? vector_type::get_na() : double( (k * 7919ll) % 400000 ) );
+	}
+	const na::kll_sketch serial = na::sketch( v, na::kll_sketch( 200 ) );
+	const na::kll_sketch parallel = na::sketch( v, na::kll_sketch( 200 ), na::parallel_t( 4 ) );
+	CHECK( serial.count() == 396000 && serial.na_count() == 4000 && parallel.count() == 396000 );
+	double worst = 0;
+	for( int q = 1; q < 100; ++q ) {
+		worst = std::max( worst, std::fabs( serial.quantile( q / 100.0 ) / 400000.0 - q / 100.0 ) );
+		worst = std::max( worst, std::fabs( parallel.quantile( q / 100.0 ) / 400000.0 - q / 100.0 ) );
+	}
+	CHECK( worst < 0.0165 );
+
+	// reseeded copies of one prototype make different choices
+	na::kll_sketch a( 50 ), b( 50 );
+	b.reseed( 1 );
+	for( int k = 0; k < 10000; ++k ) {
+		a.add( double( k ) );
+		b.add( double( k ) );
+	}
+	bool differ = false;
+	for( int q = 1; q < 100; ++q ) {
+		differ = differ || a.quantile( q / 100.0 ) != b.quantile( q / 100.0 );
+	}
+	CHECK( differ );
+
+	// NaNs that are not NA are counted apart and never binned or ranked
+	nan_vector n( 1000, 0.5 );
+	n[10] = std::numeric_limits< double >::quiet_NaN();
+	n[20] = nan_vector::get_na();
+	const na::histogram h = na::sketch( n, na::histogram( 0.0, 1.0, 10 ) );
+	CHECK( h.nan_count() == 1 && h.na_count() == 1 && h.total() == 998 && h.count( 5 ) == 998 );
+	const na::kll_sketch k = na::sketch( n, na::kll_sketch() );
+	CHECK( k.nan_count() == 1 && k.count() == 998 && k.quantile( 0.5 ) == 0.5 );
+}
+
+static void test_shared()
+{
+	typedef na::shared_vector< double > shared_type;
+	typedef na::shared_array2d< double, order::row_major > shared_array;
+
+	// create( name, 4 ) is the capacity overload, not the copy overload
+	na::remove_shared( "na_test_shared_vector" );
+	{
+		shared_type producer = shared_type::create( "na_test_shared_vector", 4 );
+		CHECK( producer.size() == 0 && producer.capacity() == 4 );
+		producer.push_back( 1.5 );
+		producer.push_back( 2.5 );
+
+		const shared_type reader = shared_type::open( "na_test_shared_vector" );
+		CHECK( reader.size() == 2 && reader[0] == 1.5 && reader[1] == 2.5 );
+		producer.resize( 4 );
+		CHECK( reader.size() == 4 && reader.is_na( 2 ) && reader.is_na( 3 ) );
+		producer.resize( 1 );
+		CHECK( reader.size() == 1 && reader[0] == 1.5 );
+
+		bool thrown = false;
+		try {
+			producer.resize( 5 );
+		} catch( const std::length_error& ) {
+			thrown = true;
+		}
+		CHECK( thrown );
+	}
+	CHECK( na::remove_shared( "na_test_shared_vector" ) );
+
+	// the copy overload still takes a vector, with room to spare
+	na::na_vector< double > v( 3, 7.0 );
+	na::remove_shared( "na_test_shared_copy" );
+	{
+		const shared_type copy = shared_type::create( "na_test_shared_copy", v, 8 );
+		const shared_type reader = shared_type::open( "na_test_shared_copy" );
+		CHECK( reader.size() == 3 && reader.capacity() == 8 && std::equal( v.begin(), v.end(), reader.begin() ) );
+	}
+	CHECK( na::remove_shared( "na_test_shared_copy" ) );
+
+	na::remove_shared( "na_test_shared_array" );
+	{
+		shared_array producer = shared_array::create( "na_test_shared_array", 2, 3, 4, 4 );
+		producer.dereference( 1, 2 ) = 5.0;
+		const shared_array reader = shared_array::open( "na_test_shared_array" );
+		CHECK( reader.rows() == 2 && reader.cols() == 3 && reader.dereference( 1, 2 ) == 5.0 );
+		producer.resize( 4, 2 );
+		CHECK( reader.rows() == 4 && reader.cols() == 2 && shared_array::policy_type::is_na( reader.dereference( 3, 1 ) ) );
+		producer.resize( 2, 3 );
+		CHECK( shared_array::policy_type::is_na( reader.dereference( 1, 2 ) ) );
+	}
+	CHECK( na::remove_shared( "na_test_shared_array" ) );
+}
+
+static void test_concurrent_array2d()
+{
+	typedef array2d< na::na_vector< double >, order::column_major > array_type;
+	na::concurrent_array2d< array_type > shared( 2, 2 );
+	shared.update( []( array_type& a ) { a.dereference( 1, 1 ) = 4.0; } );
+	CHECK( shared.retired() == 0 );
+
+	// a snapshot keeps its version alive across later writes
+	{
+		const na::concurrent_array2d< array_type >::snapshot old = shared.read();
+		shared.resize( 3, 5 );
+		shared.update( []( array_type& a ) { a.dereference( 1, 1 ) = 9.0; } );
+		CHECK( old->rows() == 2 && old->cols() == 2 && old->dereference( 1, 1 ) == 4.0 );
+		CHECK( shared.retired() == 2 );
+		shared.reclaim();
+		CHECK( shared.retired() == 2 );
+
+		const na::concurrent_array2d< array_type >::snapshot now = shared.read();
+		CHECK( now->rows() == 3 && now->cols() == 5 && now->dereference( 1, 1 ) == 9.0 );
+	}
+	shared.reclaim();
+	CHECK( shared.retired() == 0 );
+
+	// readers racing a growing writer only ever see complete versions
+	array_type first( 1, 1 );
+	first.dereference( 0, 0 ) = 1.0;
+	shared.assign( std::move( first ) );
+	std::vector< std::thread > readers;
+	std::vector< char > ok( 4, 1 );
+	for( int t = 0; t < 4; ++t ) {
+		readers.push_back( std::thread( [&shared, &ok, t]() {
+			for( int k = 0; k < 2000; ++k ) {
+				const na::concurrent_array2d< array_type >::snapshot s = shared.read();
+				if( s->rows() != s->cols() || s->dereference( s->rows() - 1, s->cols() - 1 ) != double( s->rows() ) ) {
+					ok[t] = 0;
+				}
+			}
+		} ) );
+	}
+	for( array_type::size_type n = 2; n < 200; ++n ) {
+		shared.update( [n]( array_type& a ) {
+			a.resize( n, n );
+			a.dereference( n - 1, n - 1 ) = double( n );
+		} );
+	}
+	for( std::size_t t = 0; t < readers.size(); ++t ) {
+		readers[t].join();
+	}
+	CHECK( std::count( ok.begin(), ok.end(), 0 ) == 0 );
+	shared.reclaim();
+	CHECK( shared.retired() == 0 );
+}
+
+// Visits every element of a exactly once, in address order, with its
+// position, and checks transform_elements wrote what the position says.
+template< typename Array >
+static bool check_element_visits( Array& a )
+{
+	a.transform_elements( []( std::size_t r, std::size_t c, const double& ) { return double( r * 100 + c ); } );
+	std::vector< int > seen( a.rows() * a.cols(), 0 );
+	const double* last = nullptr;
+	bool ok = true;
+	const Array& ca = a;
+	ca.for_each_element( [&]( std::size_t r, std::size_t c, const double& val ) {
+		ok = ok && val == double( r * 100 + c ) && &val == &ca.dereference( r, c ) && ( !last || &val > last );
+		last = &val;
+		++seen[r * a.cols() + c];
+	} );
+	return ok && std::count( seen.begin(), seen.end(), 1 ) == int( seen.size() );
+}
+
+static void test_elements()
+{
+	typedef array2d< na::na_vector< double >, order::column_major > col_array;
+	typedef array2d< na::na_vector< double >, order::row_major > row_array;
+
+	// contiguous storage, then with a gap after each major slice
+	col_array c( 7, 5 );
+	row_array r( 7, 5 );
+	CHECK( c.stride() == c.rows() && r.stride() == r.cols() );
+	CHECK( check_element_visits( c ) && check_element_visits( r ) );
+	c.reserve( 10, 10 );
+	r.reserve( 10, 10 );
+	CHECK( c.stride() > c.rows() && r.stride() > r.cols() );
+	CHECK( check_element_visits( c ) && check_element_visits( r ) );
+
+	// the functor comes back with its state
+	struct counter {
+		std::size_t n;
+		void operator()( std::size_t, std::size_t, double& ) { ++n; }
+	};
+	counter start = { 0 };
+	CHECK( r.for_each_element( start ).n == 35 );
+}
+
+// Broadcast operations against the obvious element by element loops, with
+// NA in the array and in both broadcast vectors.
+template< typename Array >
+static void check_broadcast()
+{
+	typedef na::na_vector< double > vector_type;
+	typedef vector_type::policy_type policy;
+	const double na = vector_type::get_na();
+	Array m( 4, 3 );
+	for( std::size_t r = 0; r < 4; ++r ) {
+		for( std::size_t c = 0; c < 3; ++c ) {
+			m.dereference( r, c ) = r == 2 && c == 1 ? na : double( r * 10 + c );
+		}
+	}
+	vector_type per_col( 3 ), per_row( 4 );
+	per_col[0] = 1.0; per_col[1] = 2.0; per_col[2] = na;
+	per_row[0] = 2.0; per_row[1] = na; per_row[2] = 4.0; per_row[3] = 8.0;
+
+	Array e = m;
+	e -= na::as_row( per_col );
+	e *= na::as_col( per_row );
+	na::add_outer( e, per_row, per_col );
+	bool ok = true;
+	for( std::size_t r = 0; r < 4; ++r ) {
+		for( std::size_t c = 0; c < 3; ++c ) {
+			const bool missing = policy::is_na( m.dereference( r, c ) ) || policy::is_na( per_col[c] ) || policy::is_na( per_row[r] );
+			const double expect = (m.dereference( r, c ) - per_col[c]) * per_row[r] + per_row[r] * per_col[c];
+			ok = ok && ( missing ? policy::is_na( e.dereference( r, c ) ) : e.dereference( r, c ) == expect );
+		}
+	}
+	CHECK( ok );
+
+	bool thrown = false;
+	try {
+		e += na::as_row( per_row );
+	} catch( const std::invalid_argument& ) {
+		thrown = true;
+	}
+	CHECK( thrown );
+
+	// standardized columns have mean 0 and variance 1; NA stays NA and a
+	// constant column is only centered
+	Array s = m;
+	for( std::size_t r = 0; r < 4; ++r ) {
+		s.dereference( r, 2 ) = 5.0;
+	}
+	na::standardize_columns( s );
+	const std::vector< na::slice_stats< double > > stats = na::column_stats( s );
+	CHECK( std::fabs( stats[0].mean ) < 1e-12 && std::fabs( stats[0].variance - 1.0 ) < 1e-12 );
+	CHECK( std::fabs( stats[1].mean ) < 1e-12 && std::fabs( stats[1].variance - 1.0 ) < 1e-12 && stats[1].count == 3 );
+	CHECK( policy::is_na( s.dereference( 2, 1 ) ) && s.dereference( 0, 2 ) == 0.0 && s.dereference( 3, 2 ) == 0.0 );
+
+	Array c = m;
+	na::center_rows( c );
+	CHECK( c.dereference( 2, 0 ) == -1.0 && c.dereference( 2, 2 ) == 1.0 && c.dereference( 1, 1 ) == 0.0 );
+}
+
+static void test_broadcast()
+{
+	check_broadcast< array2d< na::na_vector< double >, order::column_major > >();
+	check_broadcast< array2d< na::na_vector< double >, order::row_major > >();
+}
+
+// Encodes values as one block and decodes them again; true when the codec
+// is the expected one (any, if expected < 0) and every value comes back
+// bit for bit.
+template< typename Raw >
+static bool codec_round_trip( const std::vector< Raw >& values, int expected )
+{
+	typedef na::detail::frozen_codec_traits< Raw > codec;
+	na::detail::frozen_block block;
+	block.value_count = boost::uint32_t( values.size() );
+	std::vector< na::detail::bit_word > words;
+	codec::encode( values.data(), values.size(), block, words );
+	words.push_back( 0 );	// never read, keeps data() valid for empty payloads
+	std::vector< Raw > out( values.size() );
+	codec::decode( block, words.data(), out.data() );
+	return ( expected < 0 || block.codec == expected ) && std::memcmp( out.data(), values.data(), values.size() * sizeof( Raw ) ) == 0;
+}
+
+// frozen_array2d against its source through get(), copy_col(), copy_row(),
+// for_each_element() and thaw().
+template< typename Array, typename Frozen >
+static bool frozen_matches( const Array& src, const Frozen& f )
+{
+	typedef typename Array::value_type value_type;
+	bool ok = f.rows() == src.rows() && f.cols() == src.cols();
+	for( std::size_t r = 0; ok && r < src.rows(); ++r ) {
+		for( std::size_t c = 0; c < src.cols(); ++c ) {
+			ok = ok && f.get( r, c ) == src.dereference( r, c );
+		}
+	}
+	std::vector< value_type > slice( std::max( src.rows(), src.cols() ) );
+	for( std::size_t c = 0; ok && c < src.cols(); ++c ) {
+		f.copy_col( c, slice.begin() );
+		for( std::size_t r = 0; r < src.rows(); ++r ) {
+			ok = ok && slice[r] == src.dereference( r, c );
+		}
+	}
+	for( std::size_t r = 0; ok && r < src.rows(); ++r ) {
+		f.copy_row( r, slice.begin() );
+		for( std::size_t c = 0; c < src.cols(); ++c ) {
+			ok = ok && slice[c] == src.dereference( r, c );
+		}
+	}
+	std::size_t visited = 0;
+	f.for_each_element( [&]( std::size_t r, std::size_t c, const value_type& val ) {
+		ok = ok && val == src.dereference( r, c );
+		++visited;
+	} );
+	const Array thawed = f.template thaw< Array >();
+	for( std::size_t r = 0; ok && r < src.rows(); ++r ) {
+		for( std::size_t c = 0; c < src.cols(); ++c ) {
+			ok = ok && thawed.dereference( r, c ) == src.dereference( r, c );
+		}
+	}
+	return ok && visited == src.rows() * src.cols();
+}
+
+struct zero_na {
+	static const boost::int64_t value = 0;
+};
+
+static void test_frozen()
+{
+	const boost::int64_t lowest = (std::numeric_limits< boost::int64_t >::min)();
+	const boost::int64_t highest = (std::numeric_limits< boost::int64_t >::max)();
+	const boost::int64_t big = boost::int64_t(1) << 62;
+
+	// frame of reference: scattered values close to 2^62
+	std::vector< boost::int64_t > v;
+	const int scattered[] = { 5, 1, 7, 3, 0, 6, 2, 4 };
+	for( int k = 0; k < 8; ++k ) {
+		v.push_back( big + scattered[k] );
+	}
+	CHECK( codec_round_trip( v, na::detail::frozen_reference ) );
+
+	// delta: a steady ramp from 2^62, and one that wraps from the largest
+	// to the smallest value
+	v.clear();
+	for( int k = 0; k < 64; ++k ) {
+		v.push_back( big + k * 1000 );
+	}
+	CHECK( codec_round_trip( v, na::detail::frozen_delta ) );
+	v.clear();
+	for( int k = 0; k < 16; ++k ) {
+		v.push_back( boost::int64_t( boost::uint64_t( highest ) - 7 + k ) );	// wraps after highest
+	}
+	CHECK( v[8] == lowest && codec_round_trip( v, na::detail::frozen_delta ) );
+
+	// full 64-bit spans, either codec
+	const boost::int64_t extremes[] = { lowest, highest, 0, lowest, -1, highest, big, -big };
+	CHECK( codec_round_trip( std::vector< boost::int64_t >( extremes, extremes + 8 ), -1 ) );
+	const boost::uint64_t unsigned_extremes[] = { 0, ~boost::uint64_t(0), boost::uint64_t(1) << 63, 1 };
+	CHECK( codec_round_trip( std::vector< boost::uint64_t >( unsigned_extremes, unsigned_extremes + 4 ), -1 ) );
+	const boost::int32_t narrow[] = { (std::numeric_limits< boost::int32_t >::min)(), (std::numeric_limits< boost::int32_t >::max)(), -3, 3 };
+	CHECK( codec_round_trip( std::vector< boost::int32_t >( narrow, narrow + 4 ), -1 ) );
+	CHECK( codec_round_trip( std::vector< boost::int64_t >( 1, lowest ), -1 ) );
+	CHECK( codec_round_trip( std::vector< boost::int64_t >( 10, big ), na::detail::frozen_reference ) );
+
+	// XOR: repeats, signed zeros, infinities, denormals, NaN payloads and an
+	// XOR with both the top and the bottom bit set
+	std::vector< double > d;
+	const double specials[] = { 1.0, 1.0, -0.0, 0.0, std::numeric_limits< double >::infinity(), -DBL_MAX,
+								std::numeric_limits< double >::denorm_min(), std::numeric_limits< double >::quiet_NaN(), 3.25, 3.25 };
+	d.assign( specials, specials + 10 );
+	d.push_back( na::na_vector< double >::get_na() );
+	boost::uint64_t edge_bits = 0x8000000000000001ull;
+	double edge;
+	std::memcpy( &edge, &edge_bits, sizeof( edge ) );
+	d.push_back( 0.0 );
+	d.push_back( edge );
+	for( int k = 0; k < 100; ++k ) {
+		d.push_back( std::sin( k * 0.1 ) );
+	}
+	CHECK( codec_round_trip( d, na::detail::frozen_xor ) );
+	std::vector< float > f;
+	for( std::size_t k = 0; k < d.size(); ++k ) {
+		f.push_back( d[k] == -DBL_MAX ? -FLT_MAX : float( d[k] ) );
+	}
+	CHECK( codec_round_trip( f, na::detail::frozen_xor ) );
+
+	// whole arrays: NA runs at block edges, all-NA blocks and slices, and a
+	// short last block per slice
+	typedef array2d< na::na_vector< double >, order::column_major > double_array;
+	double_array a( 23, 4 );
+	const double na = na::na_vector< double >::get_na();
+	for( std::size_t r = 0; r < 23; ++r ) {
+		a.dereference( r, 0 ) = r >= 5 && r < 10 ? na : double( r ) * 0.5;		// block 1 all NA
+		a.dereference( r, 1 ) = na;												// whole slice NA
+		a.dereference( r, 2 ) = r % 3 == 0 ? na : std::cos( double( r ) );
+		a.dereference( r, 3 ) = 2.0;
+	}
+	const na::frozen_array2d< double > fa( a, 5, 2 );
+	CHECK( fa.block_count() == 20 && frozen_matches( a, fa ) );
+	const na::frozen_array2d< double > whole( a );
+	CHECK( whole.block_count() == 4 && frozen_matches( a, whole ) );
+
+	// 64-bit integers with an NA that leaves the extremes free
+	typedef na::policies::NaPolicySV< boost::int64_t, zero_na > zero_policy;
+	typedef array2d< na::na_vector< boost::int64_t, zero_policy >, order::row_major > int_array;
+	int_array b( 6, 17 );
+	for( std::size_t r = 0; r < 6; ++r ) {
+		for( std::size_t c = 0; c < 17; ++c ) {
+			const boost::int64_t k = boost::int64_t( c ) + 1;
+			switch( r ) {
+			case 0: b.dereference( r, c ) = lowest + k; break;
+			case 1: b.dereference( r, c ) = big + k * k; break;
+			case 2: b.dereference( r, c ) = c % 2 ? highest : lowest; break;
+			case 3: b.dereference( r, c ) = c < 8 ? 0 : -big * (c % 4 == 0 ? 1 : -1); break;
+			case 4: b.dereference( r, c ) = 0; break;
+			default: b.dereference( r, c ) = boost::int64_t( boost::uint64_t( highest ) - 8 + k ); break;
+			}
+		}
+	}
+	const na::frozen_array2d< boost::int64_t, order::row_major, zero_policy > fb( b, 4 );
+	CHECK( frozen_matches( b, fb ) );
+	CHECK( fb.is_na( 4, 16 ) && fb.is_na( 3, 0 ) && !fb.is_na( 3, 8 ) && fb.get( 2, 0 ) == lowest );
+}
+
+// Pairwise-complete covariance or correlation of columns a and b, two
+// passes over exactly the rows where both are non-NA.
+template< typename Array >
+static double reference_pair( const Array& arr, std::size_t a, std::size_t b, bool correlation )
+{
+	typedef typename na::detail::array_policy< Array >::type policy;
+	const double na = na::na_vector< double >::get_na();
+	double n = 0, ma = 0, mb = 0;
+	for( std::size_t r = 0; r < arr.rows(); ++r ) {
+		if( !policy::is_na( arr.dereference( r, a ) ) && !policy::is_na( arr.dereference( r, b ) ) ) {
+			n += 1;
+			ma += double( arr.dereference( r, a ) );
+			mb += double( arr.dereference( r, b ) );
+		}
+	}
+	if( n < 2 ) {
+		return na;
+	}
+	ma /= n;
+	mb /= n;
+	double cross = 0, va = 0, vb = 0;
+	for( std::size_t r = 0; r < arr.rows(); ++r ) {
+		if( !policy::is_na( arr.dereference( r, a ) ) && !policy::is_na( arr.dereference( r, b ) ) ) {
+			const double da = double( arr.dereference( r, a ) ) - ma, db = double( arr.dereference( r, b ) ) - mb;
+			cross += da * db;
+			va += da * da;
+			vb += db * db;
+		}
+	}
+	if( !correlation ) {
+		return cross / (n - 1);
+	}
+	if( !(va > 0) || !(vb > 0) ) {
+		return na;
+	}
+	return a == b ? 1.0 : cross / std::sqrt( va * vb );
+}
+
+template< typename Array, typename Result >
+static bool matches_reference( const Array& arr, const Result& result, bool correlation )
+{
+	typedef na::na_vector< double >::policy_type policy;
+	bool ok = result.rows() == arr.cols() && result.cols() == arr.cols();
+	for( std::size_t a = 0; ok && a < arr.cols(); ++a ) {
+		for( std::size_t b = 0; b < arr.cols(); ++b ) {
+			const double expect = reference_pair( arr, a, b, correlation ), got = result.dereference( a, b );
+			if( policy::is_na( expect ) ) {
+				ok = ok && policy::is_na( got );
+			} else {
+				ok = ok && !policy::is_na( got ) && std::fabs( got - expect ) <= 1e-9 * std::max( 1.0, std::fabs( expect ) );
+			}
+		}
+	}
+	return ok;
+}
+
+// Columns of every kind the kernels tell apart: NA-free ones (cross product
+// only), ones with NA (masked sums), an all-NA and a constant column, and a
+// pair that overlaps in a single row. rows spans several row blocks and
+// leaves a remainder for the four-row AVX2 loop; 70 columns make three
+// tiles per side.
+template< typename Array >
+static Array correlation_input( std::size_t rows )
+{
+	Array arr( rows, 70 );
+	const double na = na::na_vector< double >::get_na();
+	for( std::size_t c = 0; c < 70; ++c ) {
+		for( std::size_t r = 0; r < rows; ++r ) {
+			double val = 1000.0 + std::sin( double( r * (c + 1) ) * 0.01 ) * (c + 1) + double( (r * 31 + c * 17) % 13 );
+			if( c % 3 == 1 && (r * 7 + c) % 11 == 0 ) {
+				val = na;
+			}
+			if( c == 5 ) {
+				val = na;
+			}
+			if( c == 8 ) {
+				val = 42.0;
+			}
+			if( c == 10 || c == 11 ) {
+				val = (c == 10 ? r < rows / 2 + 1 : r >= rows / 2) ? double( r ) : na;
+			}
+			arr.dereference( r, c ) = val;
+		}
+	}
+	return arr;
+}
+
+static void test_correlation()
+{
+	typedef array2d< na::na_vector< double >, order::column_major > col_array;
+	typedef array2d< na::na_vector< double >, order::row_major > row_array;
+	typedef na::na_vector< double >::policy_type policy;
+
+	const col_array c = correlation_input< col_array >( 2500 + 3 );
+	CHECK( matches_reference( c, na::covariance( c ), false ) );
+	CHECK( matches_reference( c, na::correlation( c ), true ) );
+	const col_array parallel = na::correlation( c, na::parallel_t( 4 ) );
+	CHECK( matches_reference( c, parallel, true ) );
+
+	const row_array r = correlation_input< row_array >( 37 );
+	CHECK( matches_reference( r, na::covariance( r ), false ) );
+	CHECK( matches_reference( r, na::correlation( r ), true ) );
+
+	// the single shared row of columns 10 and 11 is not enough
+	const col_array cov = na::covariance( c );
+	CHECK( policy::is_na( cov.dereference( 10, 11 ) ) && !policy::is_na( cov.dereference( 10, 10 ) ) );
+	CHECK( policy::is_na( na::correlation( c ).dereference( 8, 0 ) ) && cov.dereference( 8, 0 ) == 0.0 );
+
+	// an integer array goes through the same kernels
+	array2d< na::na_vector< int >, order::column_major > ints( 9, 3 );
+	for( std::size_t row = 0; row < 9; ++row ) {
+		ints.dereference( row, 0 ) = int( row );
+		ints.dereference( row, 1 ) = row == 4 ? na::na_vector< int >::get_na() : int( row * row );
+		ints.dereference( row, 2 ) = 9 - int( row );
+	}
+	CHECK( matches_reference( ints, na::covariance( ints ), false ) );
+	CHECK( na::correlation( ints ).dereference( 0, 2 ) == -1.0 );
+}
 
 int main()
 {
 	typedef na::na_vector< float, na::policies::NaPolicyOptional<float> > na_vector1_optional;
 	typedef na::na_vector< float > na_vector1_special;
-	typedef na::na_vector< float, na::policies::NaPolicySV<float,nan_value> > na_vector1_special_nan;
+	typedef na::na_vector< float, na::policies::NaPolicyNaN<float> > na_vector1_special_nan;
 
 	typedef array2d< na_vector1_special, order::row_major > array_type1;
 	typedef array2d< na_vector1_special, order::column_major > array_type2;
@@ -77,4 +1519,31 @@ int main()
 	wcout << sizeof( array_type1 ) << L'\n';
 	wcout << sizeof( std::vector< double > ) + 2*sizeof(array_type1::size_type) << L'\n';
 
+	test_fill();
+	test_segmented_vector();
+	test_concurrent_vector();
+	test_cow_vector();
+	test_aligned_stride();
+	test_fixed_array();
+	test_stats();
+	test_selection();
+	test_take();
+	test_table();
+	test_parallel_init();
+	test_profile();
+	test_mask();
+	test_string_vector();
+	test_nan_policy();
+	test_convert();
+	test_zip();
+	test_scan();
+	test_sketch();
+	test_shared();
+	test_concurrent_array2d();
+	test_elements();
+	test_broadcast();
+	test_frozen();
+	test_correlation();
+
+	return failures ? 1 : 0;
 }
\ No newline at end of file